@@ -0,0 +1,505 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "buf.h"
+#include "events.h"
+#include "hbr.h"
+#include "intern.h"
+#include "player.h"
+#include "sketch.h"
+#include "stream_reader.h"
+#include "timeline.h"
+#include "aggregate.h"
+
+#define HB_AGGREGATE_VERSION (1)
+// Magic, version and replay count.
+#define HB_AGGREGATE_HEADER_SIZE (16)
+
+static bool hb_aggregate_key_equal(const struct hb_aggregate_key *key, const char *str,
+		size_t len, uint64_t hash)
+{
+	return key->hash == hash && key->len == len && !memcmp(key->str, str, len);
+}
+
+static const struct hb_aggregate_key *hb_aggregate_table_key(const struct hb_aggregate_table *t,
+		size_t i)
+{
+	return (const void *) &t->entries[i * t->stride];
+}
+
+static void hb_aggregate_table_index(struct hb_aggregate_table *t, size_t i)
+{
+	size_t mask = t->slot_cap - 1;
+	size_t slot = hb_aggregate_table_key(t, i)->hash & mask;
+	while (t->slots[slot] != 0) slot = (slot + 1) & mask;
+	t->slots[slot] = (uint32_t) i + 1;
+}
+
+static void *hb_aggregate_table_get(struct hb_aggregate_table *t, const char *str, size_t len)
+{
+	uint64_t hash = hb_sketch_hash(str, len);
+	size_t mask = t->slot_cap - 1;
+	struct hb_aggregate_key key = { .len = len, .hash = hash };
+	char *copy;
+
+	if (t->slot_cap) {
+		for (size_t slot = hash & mask; t->slots[slot] != 0; slot = (slot + 1) & mask) {
+			if (hb_aggregate_key_equal(hb_aggregate_table_key(t, t->slots[slot] - 1), str, len, hash))
+				return &t->entries[(t->slots[slot] - 1) * t->stride];
+		}
+	}
+
+	copy = hb_arena_alloc(&t->strings, len + 1);
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+	key.str = copy;
+
+	if (t->length == t->cap) {
+		t->cap = t->cap ? t->cap * 2 : 64;
+		t->entries = realloc(t->entries, t->cap * t->stride);
+		assert(t->entries != NULL);
+	}
+
+	uint8_t *entry = &t->entries[t->length * t->stride];
+	memset(entry, 0, t->stride);
+	memcpy(entry, &key, sizeof(key));
+	t->length += 1;
+
+	// Slots stay at most half full.
+	if (t->length * 2 > t->slot_cap) {
+		t->slot_cap = t->slot_cap ? t->slot_cap * 2 : 128;
+		free(t->slots);
+		t->slots = calloc(t->slot_cap, sizeof(*t->slots));
+		assert(t->slots != NULL);
+		for (size_t i = 0; i < t->length; ++i)
+			hb_aggregate_table_index(t, i);
+	} else {
+		hb_aggregate_table_index(t, t->length - 1);
+	}
+
+	return entry;
+}
+
+static void hb_aggregate_table_free(struct hb_aggregate_table *t)
+{
+	free(t->entries);
+	free(t->slots);
+	hb_arena_free(&t->strings);
+}
+
+void hb_aggregate_init(struct hb_aggregate *agg)
+{
+	memset(agg, 0, sizeof(*agg));
+	agg->rooms.stride = sizeof(struct hb_aggregate_room);
+	agg->countries.stride = sizeof(struct hb_aggregate_country);
+}
+
+static struct hb_aggregate_country *hb_aggregate_country(struct hb_aggregate *agg,
+		uint32_t code)
+{
+	return hb_aggregate_table_get(&agg->countries, hb_intern_str(code), hb_intern_len(code));
+}
+
+// Keeps the names with the highest estimates, a name is only known while
+// it is on that list but its frames are always counted. Names that drop
+// off the list are freed, so it never holds more than its own strings.
+static void hb_aggregate_stadium_offer(struct hb_aggregate *agg, const char *name, size_t len)
+{
+	uint64_t hash = hb_sketch_hash(name, len);
+	uint64_t estimate = hb_cms_estimate(&agg->stadium_frames, hash);
+	size_t min = 0;
+	uint64_t min_estimate = UINT64_MAX;
+	char *copy;
+
+	for (size_t i = 0; i < agg->stadium_count; ++i) {
+		if (hb_aggregate_key_equal(&agg->stadiums[i], name, len, hash)) return;
+		uint64_t e = hb_cms_estimate(&agg->stadium_frames, agg->stadiums[i].hash);
+		if (e < min_estimate) {
+			min = i;
+			min_estimate = e;
+		}
+	}
+
+	if (agg->stadium_count < HB_AGGREGATE_TOP_STADIUMS) min = agg->stadium_count++;
+	else if (estimate <= min_estimate) return;
+	else free((char *) agg->stadiums[min].str);
+
+	copy = malloc(len + 1);
+	assert(copy != NULL);
+	memcpy(copy, name, len);
+	copy[len] = '\0';
+	agg->stadiums[min] = (struct hb_aggregate_key) { copy, len, hash };
+}
+
+static void hb_aggregate_stadium(struct hb_aggregate *agg, uint32_t name, uint64_t frames)
+{
+	if (frames == 0) return;
+	hb_cms_add(&agg->stadium_frames, hb_intern_hash(name), frames);
+	hb_aggregate_stadium_offer(agg, hb_intern_str(name), hb_intern_len(name));
+}
+
+struct hb_aggregate_visit
+{
+	struct hb_aggregate *agg;
+	struct hb_aggregate_room *room;
+	struct { uint32_t id, frame, country; } present[HB_PLAYER_LIST_MAX_PLAYERS];
+	size_t present_count;
+	uint32_t stadium, stadium_frame;
+};
+
+static void hb_aggregate_join(struct hb_aggregate_visit *ctx, const struct hb_player *player,
+		uint32_t frame)
+{
+	hb_hll_add(&ctx->room->players, hb_intern_hash(player->name));
+	if (ctx->present_count == HB_PLAYER_LIST_MAX_PLAYERS) return;
+	ctx->present[ctx->present_count].id = player->id;
+	ctx->present[ctx->present_count].frame = frame;
+	ctx->present[ctx->present_count].country = player->country;
+	ctx->present_count += 1;
+}
+
+static void hb_aggregate_leave(struct hb_aggregate_visit *ctx, size_t i, uint32_t frame)
+{
+	struct hb_aggregate_country *country = hb_aggregate_country(ctx->agg, ctx->present[i].country);
+	if (frame > ctx->present[i].frame)
+		country->seconds += (frame - ctx->present[i].frame) / (double) HB_FRAMES_PER_SECOND;
+	ctx->present[i] = ctx->present[--ctx->present_count];
+}
+
+static void on_player_join(struct hbr *hbr, const struct hbr_visit *v, void *data)
+{
+	hb_aggregate_join(data, v->player_join.player, hbr->current_frame);
+}
+
+static void on_player_leave(struct hbr *hbr, const struct hbr_visit *v, void *data)
+{
+	struct hb_aggregate_visit *ctx = data;
+	for (size_t i = 0; i < ctx->present_count; ++i) {
+		if (ctx->present[i].id == v->player_leave.id) {
+			hb_aggregate_leave(ctx, i, hbr->current_frame);
+			return;
+		}
+	}
+}
+
+// Pings come in the order of the player list.
+static void on_ping_update(struct hbr *hbr, const struct hbr_visit *v, void *data)
+{
+	struct hb_aggregate_visit *ctx = data;
+	for (size_t i = 0; i < v->ping_update.ping_count && i < hbr->player_list.length; ++i) {
+		struct hb_aggregate_country *country = hb_aggregate_country(ctx->agg,
+				hbr->player_list.players[i].country);
+		hb_tdigest_add(&country->pings, v->ping_update.pings[i] * 4.0, 1.0);
+	}
+}
+
+static void on_stadium_change(struct hbr *hbr, const struct hbr_visit *v, void *data)
+{
+	struct hb_aggregate_visit *ctx = data;
+	hb_aggregate_stadium(ctx->agg, ctx->stadium, hbr->current_frame - ctx->stadium_frame);
+	ctx->stadium = hb_intern_cstr(v->set_stadium.default_stadium ? v->set_stadium.default_stadium :
+			v->set_stadium.stadium->name);
+	ctx->stadium_frame = hbr->current_frame;
+}
+
+static const struct hbr_visitor aggregate_visitor = { .on = {
+	[HB_EVENT_PLAYER_JOIN]  = on_player_join,
+	[HB_EVENT_PLAYER_LEAVE] = on_player_leave,
+	[HB_EVENT_PING_UPDATE]  = on_ping_update,
+	[HB_EVENT_SET_STADIUM]  = on_stadium_change
+} };
+
+void hb_aggregate_replay(struct hb_aggregate *agg, struct hbr *hbr)
+{
+	struct hb_aggregate_visit ctx = { .agg = agg };
+	struct hbr_visitor visitor = aggregate_visitor;
+	uint32_t end;
+
+	ctx.room = hb_aggregate_table_get(&agg->rooms, hb_intern_str(hbr->room_name),
+			hb_intern_len(hbr->room_name));
+	for (size_t i = 0; i < hbr->player_list.length; ++i)
+		hb_aggregate_join(&ctx, &hbr->player_list.players[i], 0);
+	ctx.stadium = hb_intern_cstr(hbr->default_stadium ? hbr->default_stadium : hbr->stadium.name);
+
+	visitor.data = &ctx;
+	hbr_visit(hbr, &visitor);
+
+	end = hbr->total_frames > hbr->current_frame ? hbr->total_frames : hbr->current_frame;
+	while (ctx.present_count > 0)
+		hb_aggregate_leave(&ctx, ctx.present_count - 1, end);
+	hb_aggregate_stadium(agg, ctx.stadium, end - ctx.stadium_frame);
+	agg->replays += 1;
+}
+
+void hb_aggregate_merge(struct hb_aggregate *dst, const struct hb_aggregate *src)
+{
+	const struct hb_aggregate_room *rooms = (const void *) src->rooms.entries;
+	const struct hb_aggregate_country *countries = (const void *) src->countries.entries;
+
+	dst->replays += src->replays;
+	for (size_t i = 0; i < src->rooms.length; ++i) {
+		struct hb_aggregate_room *room = hb_aggregate_table_get(&dst->rooms, rooms[i].name.str,
+				rooms[i].name.len);
+		hb_hll_merge(&room->players, &rooms[i].players);
+	}
+	for (size_t i = 0; i < src->countries.length; ++i) {
+		struct hb_aggregate_country *country = hb_aggregate_table_get(&dst->countries,
+				countries[i].code.str, countries[i].code.len);
+		country->seconds += countries[i].seconds;
+		hb_tdigest_merge(&country->pings, &countries[i].pings);
+	}
+	hb_cms_merge(&dst->stadium_frames, &src->stadium_frames);
+	for (size_t i = 0; i < src->stadium_count; ++i)
+		hb_aggregate_stadium_offer(dst, src->stadiums[i].str, src->stadiums[i].len);
+}
+
+// Sketches are mostly empty for small partials, only set registers and
+// counters are written then.
+static void hb_aggregate_write_hll(struct hb_buf *b, const struct hb_hll *hll)
+{
+	uint16_t set = 0;
+	for (size_t i = 0; i < HB_HLL_REGISTERS; ++i) set += hll->registers[i] != 0;
+
+	if (set * 3 < HB_HLL_REGISTERS) {
+		hb_buf_put_uint16(b, set);
+		for (size_t i = 0; i < HB_HLL_REGISTERS; ++i) {
+			if (hll->registers[i] == 0) continue;
+			hb_buf_put_uint16(b, (uint16_t) i);
+			hb_buf_put_uint8(b, hll->registers[i]);
+		}
+	} else {
+		hb_buf_put_uint16(b, UINT16_MAX);
+		hb_buf_put(b, hll->registers, HB_HLL_REGISTERS);
+	}
+}
+
+static void hb_aggregate_read_hll(struct hb_stream_reader *s, struct hb_hll *hll)
+{
+	uint16_t set = hb_stream_reader_uint16(s);
+
+	if (set == UINT16_MAX) {
+		for (size_t i = 0; i < HB_HLL_REGISTERS; ++i)
+			hll->registers[i] = hb_stream_reader_uint8(s);
+		return;
+	}
+
+	while (set-- > 0 && !s->failed) {
+		uint16_t i = hb_stream_reader_uint16(s);
+		if (i >= HB_HLL_REGISTERS) {
+			hb_stream_reader_fail(s);
+			return;
+		}
+		hll->registers[i] = hb_stream_reader_uint8(s);
+	}
+}
+
+static void hb_aggregate_write_tdigest(struct hb_buf *b, struct hb_tdigest *td)
+{
+	hb_tdigest_compress(td);
+	hb_buf_put_uint32(b, (uint32_t) td->length);
+	for (size_t i = 0; i < td->length; ++i) {
+		hb_buf_put_double(b, td->centroids[i].mean);
+		hb_buf_put_double(b, td->centroids[i].weight);
+	}
+}
+
+static void hb_aggregate_read_tdigest(struct hb_stream_reader *s, struct hb_tdigest *td)
+{
+	uint32_t length = hb_stream_reader_uint32(s);
+	while (length-- > 0 && !s->failed) {
+		double mean = hb_stream_reader_double(s);
+		hb_tdigest_add(td, mean, hb_stream_reader_double(s));
+	}
+}
+
+void hb_aggregate_write(const struct hb_aggregate *agg, const char *path)
+{
+	struct hb_aggregate_room *rooms = (void *) agg->rooms.entries;
+	struct hb_aggregate_country *countries = (void *) agg->countries.entries;
+	struct hb_buf b = {0};
+	uint32_t counters = 0;
+	FILE *fp;
+
+	hb_buf_put_uint32(&b, HB_AGGREGATE_MAGIC);
+	hb_buf_put_uint32(&b, HB_AGGREGATE_VERSION);
+	hb_buf_put_uint64(&b, agg->replays);
+
+	hb_buf_put_uint32(&b, (uint32_t) agg->rooms.length);
+	for (size_t i = 0; i < agg->rooms.length; ++i) {
+		hb_buf_put_string(&b, rooms[i].name.str);
+		hb_aggregate_write_hll(&b, &rooms[i].players);
+	}
+
+	hb_buf_put_uint32(&b, (uint32_t) agg->countries.length);
+	for (size_t i = 0; i < agg->countries.length; ++i) {
+		hb_buf_put_string(&b, countries[i].code.str);
+		hb_buf_put_double(&b, countries[i].seconds);
+		hb_aggregate_write_tdigest(&b, &countries[i].pings);
+	}
+
+	for (size_t i = 0; i < HB_CMS_DEPTH; ++i)
+		for (size_t j = 0; j < HB_CMS_WIDTH; ++j)
+			counters += agg->stadium_frames.counts[i][j] != 0;
+	hb_buf_put_uint32(&b, counters);
+	for (size_t i = 0; i < HB_CMS_DEPTH; ++i) {
+		for (size_t j = 0; j < HB_CMS_WIDTH; ++j) {
+			if (agg->stadium_frames.counts[i][j] == 0) continue;
+			hb_buf_put_uint32(&b, (uint32_t) (i * HB_CMS_WIDTH + j));
+			hb_buf_put_uint64(&b, agg->stadium_frames.counts[i][j]);
+		}
+	}
+
+	hb_buf_put_uint32(&b, (uint32_t) agg->stadium_count);
+	for (size_t i = 0; i < agg->stadium_count; ++i)
+		hb_buf_put_string(&b, agg->stadiums[i].str);
+
+	fp = fopen(path, "wb");
+	assert(fp != NULL);
+	bool written = fwrite(b.data, 1, b.len, fp) == b.len;
+	written = fclose(fp) == 0 && written;
+	assert(written);
+	(void) written;
+	hb_buf_free(&b);
+}
+
+// Partials may be missing or cut short by a worker that died, those are
+// rejected instead of merged with whatever part of them was written.
+bool hb_aggregate_read(struct hb_aggregate *agg, const char *path)
+{
+	FILE *fp = fopen(path, "rb");
+	struct hb_stream_reader *s;
+	uint32_t count;
+	long size;
+	bool valid;
+
+	if (NULL == fp) return false;
+	if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < HB_AGGREGATE_HEADER_SIZE || fseek(fp, 0, SEEK_SET) != 0) {
+		fclose(fp);
+		return false;
+	}
+	s = hb_stream_reader_new(NULL, (size_t) size);
+	assert(s != NULL);
+	valid = fread(s->data, 1, s->len, fp) == s->len;
+	fclose(fp);
+
+	if (!valid || hb_stream_reader_uint32(s) != HB_AGGREGATE_MAGIC ||
+			hb_stream_reader_uint32(s) != HB_AGGREGATE_VERSION) {
+		hb_stream_reader_free(s);
+		return false;
+	}
+
+	agg->replays = hb_stream_reader_uint64(s);
+
+	for (count = hb_stream_reader_uint32(s); count > 0 && !s->failed; --count) {
+		struct hb_str_view name = hb_stream_reader_string_view(s);
+		struct hb_aggregate_room *room = hb_aggregate_table_get(&agg->rooms, name.data, name.len);
+		hb_aggregate_read_hll(s, &room->players);
+	}
+
+	for (count = hb_stream_reader_uint32(s); count > 0 && !s->failed; --count) {
+		struct hb_str_view code = hb_stream_reader_string_view(s);
+		struct hb_aggregate_country *country = hb_aggregate_table_get(&agg->countries,
+				code.data, code.len);
+		country->seconds = hb_stream_reader_double(s);
+		hb_aggregate_read_tdigest(s, &country->pings);
+	}
+
+	for (count = hb_stream_reader_uint32(s); count > 0 && !s->failed; --count) {
+		uint32_t i = hb_stream_reader_uint32(s);
+		if (i >= HB_CMS_DEPTH * HB_CMS_WIDTH) {
+			hb_stream_reader_fail(s);
+			break;
+		}
+		agg->stadium_frames.counts[i / HB_CMS_WIDTH][i % HB_CMS_WIDTH] = hb_stream_reader_uint64(s);
+	}
+
+	for (count = hb_stream_reader_uint32(s); count > 0 && !s->failed; --count) {
+		struct hb_str_view name = hb_stream_reader_string_view(s);
+		hb_aggregate_stadium_offer(agg, name.data, name.len);
+	}
+
+	valid = !s->failed && s->offset == s->len;
+	hb_stream_reader_free(s);
+	return valid;
+}
+
+static int hb_aggregate_compare_rooms(const void *a, const void *b)
+{
+	double x = hb_hll_estimate(&((const struct hb_aggregate_room *) a)->players);
+	double y = hb_hll_estimate(&((const struct hb_aggregate_room *) b)->players);
+	return (x < y) - (x > y);
+}
+
+static int hb_aggregate_compare_countries(const void *a, const void *b)
+{
+	double x = ((const struct hb_aggregate_country *) a)->seconds;
+	double y = ((const struct hb_aggregate_country *) b)->seconds;
+	return (x < y) - (x > y);
+}
+
+// Sorting moves entries, the tables are no longer usable afterwards.
+void hb_aggregate_print(struct hb_aggregate *agg, FILE *out)
+{
+	struct hb_aggregate_room *rooms = (void *) agg->rooms.entries;
+	struct hb_aggregate_country *countries = (void *) agg->countries.entries;
+	uint64_t frames[HB_AGGREGATE_TOP_STADIUMS];
+
+	fprintf(out, "Replays: %llu\n", (unsigned long long) agg->replays);
+
+	qsort(rooms, agg->rooms.length, sizeof(*rooms), hb_aggregate_compare_rooms);
+	fprintf(out, "Unique players per room:\n");
+	for (size_t i = 0; i < agg->rooms.length; ++i)
+		fprintf(out, "	%s: ~%.0f\n", rooms[i].name.str, hb_hll_estimate(&rooms[i].players));
+
+	qsort(countries, agg->countries.length, sizeof(*countries), hb_aggregate_compare_countries);
+	fprintf(out, "Play time and ping per country:\n");
+	for (size_t i = 0; i < agg->countries.length; ++i) {
+		struct hb_tdigest *pings = &countries[i].pings;
+		fprintf(out, "	%s: %.1f h", countries[i].code.len ? countries[i].code.str : "??",
+				countries[i].seconds / 3600.0);
+		if (pings->total > 0)
+			fprintf(out, ", ping p50 %.0f ms p90 %.0f ms p99 %.0f ms",
+					hb_tdigest_quantile(pings, 0.5), hb_tdigest_quantile(pings, 0.9),
+					hb_tdigest_quantile(pings, 0.99));
+		fprintf(out, "\n");
+	}
+
+	for (size_t i = 0; i < agg->stadium_count; ++i)
+		frames[i] = hb_cms_estimate(&agg->stadium_frames, agg->stadiums[i].hash);
+	fprintf(out, "Most played stadiums:\n");
+	for (size_t n = 0; n < agg->stadium_count && n < 10; ++n) {
+		size_t best = 0;
+		for (size_t i = 1; i < agg->stadium_count; ++i)
+			if (frames[i] > frames[best]) best = i;
+		if (frames[best] == 0) break;
+		fprintf(out, "	%s: %.1f h\n", agg->stadiums[best].str, frames[best] / (HB_FRAMES_PER_SECOND * 3600.0));
+		frames[best] = 0;
+	}
+}
+
+void hb_aggregate_free(struct hb_aggregate *agg)
+{
+	hb_aggregate_table_free(&agg->rooms);
+	hb_aggregate_table_free(&agg->countries);
+	for (size_t i = 0; i < agg->stadium_count; ++i)
+		free((char *) agg->stadiums[i].str);
+}
@@ -0,0 +1,82 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "arena.h"
+#include "hbr.h"
+#include "sketch.h"
+
+#define HB_AGGREGATE_MAGIC (0x48424147)
+#define HB_AGGREGATE_TOP_STADIUMS (64)
+
+// Aggregates outlive the intern pool, which is reset after every replay,
+// so they hold their own copy of every string they keep.
+struct hb_aggregate_key
+{
+	const char *str;
+	size_t len;
+	uint64_t hash;
+};
+
+// Entries keyed by a string, the key is the first member of every entry
+// and its string lives in `strings`.
+struct hb_aggregate_table
+{
+	uint8_t *entries;
+	size_t stride, length, cap;
+	uint32_t *slots;
+	size_t slot_cap;
+	struct hb_arena strings;
+};
+
+struct hb_aggregate_room
+{
+	struct hb_aggregate_key name;
+	struct hb_hll players;
+};
+
+struct hb_aggregate_country
+{
+	struct hb_aggregate_key code;
+	double seconds;
+	struct hb_tdigest pings;
+};
+
+// Results over any number of replays that never hold per-replay data:
+// unique player names per room, time in room and pings per country, and
+// the stadiums with the most frames played (count-min sketch plus the
+// names most likely to be on top, rechecked on every update).
+struct hb_aggregate
+{
+	uint64_t replays;
+	struct hb_aggregate_table rooms, countries;
+	struct hb_cms stadium_frames;
+	struct hb_aggregate_key stadiums[HB_AGGREGATE_TOP_STADIUMS];
+	size_t stadium_count;
+};
+
+void hb_aggregate_init(struct hb_aggregate *agg);
+void hb_aggregate_replay(struct hb_aggregate *agg, struct hbr *hbr);
+void hb_aggregate_merge(struct hb_aggregate *dst, const struct hb_aggregate *src);
+void hb_aggregate_write(const struct hb_aggregate *agg, const char *path);
+bool hb_aggregate_read(struct hb_aggregate *agg, const char *path);
+void hb_aggregate_print(struct hb_aggregate *agg, FILE *out);
+void hb_aggregate_free(struct hb_aggregate *agg);
@@ -0,0 +1,105 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define HB_ARENA_ALIGN(n) (((n) + 15) & ~(size_t)15)
+
+static struct hb_arena_chunk *hb_arena_chunk_new(size_t len)
+{
+	size_t cap = len > HB_ARENA_CHUNK_SIZE ? len : HB_ARENA_CHUNK_SIZE;
+	struct hb_arena_chunk *chunk = malloc(sizeof(*chunk) + cap);
+	assert(chunk != NULL);
+	chunk->next = NULL;
+	chunk->cap = cap;
+	chunk->used = 0;
+	return chunk;
+}
+
+void *hb_arena_alloc(struct hb_arena *a, size_t len)
+{
+	struct hb_arena_chunk *chunk = a->current;
+
+	len = HB_ARENA_ALIGN(len);
+
+	if (NULL == chunk) {
+		chunk = a->first = a->current = hb_arena_chunk_new(len);
+	} else if (chunk->cap - chunk->used < len) {
+		// Chunks after the current one are left over from before the last
+		// reset, reuse the next one when it is big enough.
+		if (chunk->next != NULL && chunk->next->cap >= len) {
+			chunk = chunk->next;
+		} else {
+			struct hb_arena_chunk *fresh = hb_arena_chunk_new(len);
+			fresh->next = chunk->next;
+			chunk->next = fresh;
+			chunk = fresh;
+		}
+		chunk->used = 0;
+		a->current = chunk;
+	}
+
+	a->last = &chunk->data[chunk->used];
+	chunk->used += len;
+	return a->last;
+}
+
+void *hb_arena_calloc(struct hb_arena *a, size_t len)
+{
+	return memset(hb_arena_alloc(a, len), 0, len);
+}
+
+void *hb_arena_realloc(struct hb_arena *a, void *ptr, size_t old_len, size_t len)
+{
+	struct hb_arena_chunk *chunk = a->current;
+
+	if (NULL == ptr) return hb_arena_alloc(a, len);
+
+	// The last allocation can grow in place while the chunk has room.
+	if (ptr == a->last) {
+		size_t offset = (uint8_t *) ptr - chunk->data;
+		if (chunk->cap - offset >= HB_ARENA_ALIGN(len)) {
+			chunk->used = offset + HB_ARENA_ALIGN(len);
+			return ptr;
+		}
+	}
+
+	void *moved = hb_arena_alloc(a, len);
+	memcpy(moved, ptr, old_len < len ? old_len : len);
+	return moved;
+}
+
+void hb_arena_reset(struct hb_arena *a)
+{
+	a->current = a->first;
+	a->last = NULL;
+	if (a->first) a->first->used = 0;
+}
+
+void hb_arena_free(struct hb_arena *a)
+{
+	struct hb_arena_chunk *chunk = a->first;
+	while (chunk != NULL) {
+		struct hb_arena_chunk *next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	a->first = a->current = NULL;
+	a->last = NULL;
+}
@@ -0,0 +1,43 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HB_ARENA_CHUNK_SIZE (1024*1024)
+
+struct hb_arena_chunk
+{
+	struct hb_arena_chunk *next;
+	size_t cap, used;
+	uint8_t data[];
+};
+
+// Bump allocator for everything a replay needs while it is parsed. Nothing
+// is freed on its own, hb_arena_reset() drops every allocation at once but
+// keeps the chunks around so the next replay reuses the same memory.
+// A zeroed struct is an empty arena.
+struct hb_arena
+{
+	struct hb_arena_chunk *first, *current;
+	void *last;
+};
+
+void *hb_arena_alloc(struct hb_arena *a, size_t len);
+void *hb_arena_calloc(struct hb_arena *a, size_t len);
+void *hb_arena_realloc(struct hb_arena *a, void *ptr, size_t old_len, size_t len);
+void hb_arena_reset(struct hb_arena *a);
+void hb_arena_free(struct hb_arena *a);
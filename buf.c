@@ -0,0 +1,81 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <assert.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "buf.h"
+
+void hb_buf_reserve(struct hb_buf *b, size_t len)
+{
+	if (b->cap - b->len >= len) return;
+	while (b->cap - b->len < len)
+		b->cap = b->cap ? b->cap * 2 : 4096;
+	b->data = realloc(b->data, b->cap);
+	assert(b->data != NULL);
+}
+
+void hb_buf_put(struct hb_buf *b, const void *data, size_t len)
+{
+	hb_buf_reserve(b, len);
+	memcpy(&b->data[b->len], data, len);
+	b->len += len;
+}
+
+void hb_buf_put_uint8(struct hb_buf *b, uint8_t v)
+{
+	hb_buf_put(b, &v, 1);
+}
+
+void hb_buf_put_uint16(struct hb_buf *b, uint16_t v)
+{
+	uint8_t data[2] = { v >> 8, v };
+	hb_buf_put(b, &data[0], sizeof(data));
+}
+
+void hb_buf_put_uint32(struct hb_buf *b, uint32_t v)
+{
+	uint8_t data[4] = { v >> 24, v >> 16, v >> 8, v };
+	hb_buf_put(b, &data[0], sizeof(data));
+}
+
+void hb_buf_put_uint64(struct hb_buf *b, uint64_t v)
+{
+	hb_buf_put_uint32(b, (uint32_t) (v >> 32));
+	hb_buf_put_uint32(b, (uint32_t) v);
+}
+
+void hb_buf_put_double(struct hb_buf *b, double v)
+{
+	uint64_t bits;
+	memcpy(&bits, &v, sizeof(bits));
+	hb_buf_put_uint64(b, bits);
+}
+
+void hb_buf_put_string(struct hb_buf *b, const char *str)
+{
+	size_t len = strlen(str);
+	if (len > UINT16_MAX) len = UINT16_MAX;
+	hb_buf_put_uint16(b, (uint16_t) len);
+	hb_buf_put(b, str, len);
+}
+
+void hb_buf_free(struct hb_buf *b)
+{
+	free(b->data);
+	b->data = NULL;
+	b->len = b->cap = 0;
+}
@@ -0,0 +1,36 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Growable byte buffer, integers are written big endian to match
+// hb_stream_reader.
+struct hb_buf
+{
+	uint8_t *data;
+	size_t len, cap;
+};
+
+void hb_buf_reserve(struct hb_buf *b, size_t len);
+void hb_buf_put(struct hb_buf *b, const void *data, size_t len);
+void hb_buf_put_uint8(struct hb_buf *b, uint8_t v);
+void hb_buf_put_uint16(struct hb_buf *b, uint16_t v);
+void hb_buf_put_uint32(struct hb_buf *b, uint32_t v);
+void hb_buf_put_uint64(struct hb_buf *b, uint64_t v);
+void hb_buf_put_double(struct hb_buf *b, double v);
+void hb_buf_put_string(struct hb_buf *b, const char *str);
+void hb_buf_free(struct hb_buf *b);
@@ -0,0 +1,180 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "buf.h"
+#include "dedup.h"
+#include "stream_reader.h"
+
+#define HB_FP_PRIME1 (0x9e3779b185ebca87ull)
+#define HB_FP_PRIME2 (0xc2b2ae3d27d4eb4full)
+
+static uint64_t hb_fingerprint_round(uint64_t acc, uint64_t word)
+{
+	acc += word * HB_FP_PRIME2;
+	acc = (acc << 31) | (acc >> 33);
+	return acc * HB_FP_PRIME1;
+}
+
+static uint64_t hb_fingerprint_mix(uint64_t h)
+{
+	h ^= h >> 30; h *= 0xbf58476d1ce4e5b9;
+	h ^= h >> 27; h *= 0x94d049bb133111eb;
+	h ^= h >> 31;
+	return h;
+}
+
+// Words are read little endian whatever the host, a set file is then
+// valid on any of them. Compiles to a plain load where it can.
+static uint64_t hb_fingerprint_word(const uint8_t *p)
+{
+	return (uint64_t) p[0] | (uint64_t) p[1] << 8 | (uint64_t) p[2] << 16 |
+		(uint64_t) p[3] << 24 | (uint64_t) p[4] << 32 | (uint64_t) p[5] << 40 |
+		(uint64_t) p[6] << 48 | (uint64_t) p[7] << 56;
+}
+
+// Four independent lanes of 8 bytes each per step (the xxHash64 round),
+// folded pairwise into the two halves. Runs at memory speed, unlike the
+// byte at a time hash the sketches use for short keys.
+struct hb_fingerprint hb_fingerprint(const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	uint64_t v[4] = { HB_FP_PRIME1, HB_FP_PRIME2, ~HB_FP_PRIME1, ~HB_FP_PRIME2 };
+	uint8_t tail[32] = {0};
+	size_t i = 0;
+
+	for (; i + sizeof(tail) <= len; i += sizeof(tail))
+		for (size_t j = 0; j < 4; ++j)
+			v[j] = hb_fingerprint_round(v[j], hb_fingerprint_word(&p[i + j * 8]));
+
+	memcpy(tail, &p[i], len - i);
+	for (size_t j = 0; j < 4; ++j)
+		v[j] = hb_fingerprint_round(v[j], hb_fingerprint_word(&tail[j * 8]) ^ len);
+
+	struct hb_fingerprint fp = {
+		hb_fingerprint_mix(v[0] ^ hb_fingerprint_mix(v[1])),
+		hb_fingerprint_mix(v[2] ^ hb_fingerprint_mix(v[3]))
+	};
+	if (fp.lo == 0 && fp.hi == 0) fp.lo = 1;
+	return fp;
+}
+
+static bool hb_dedup_insert(struct hb_dedup *d, struct hb_fingerprint fp)
+{
+	if ((d->length + 1) * 2 > d->cap) {
+		struct hb_fingerprint *old = d->slots;
+		size_t old_cap = d->cap;
+
+		d->cap = d->cap ? d->cap * 2 : 1024;
+		d->slots = calloc(d->cap, sizeof(*d->slots));
+		assert(d->slots != NULL);
+		d->length = 0;
+		for (size_t i = 0; i < old_cap; ++i)
+			if (old[i].lo || old[i].hi) hb_dedup_insert(d, old[i]);
+		free(old);
+	}
+
+	for (size_t i = fp.lo & (d->cap - 1); ; i = (i + 1) & (d->cap - 1)) {
+		struct hb_fingerprint *slot = &d->slots[i];
+		if (slot->lo == fp.lo && slot->hi == fp.hi) return false;
+		if (slot->lo == 0 && slot->hi == 0) {
+			*slot = fp;
+			d->length += 1;
+			return true;
+		}
+	}
+}
+
+bool hb_dedup_open(struct hb_dedup *d, const char *path)
+{
+	memset(d, 0, sizeof(*d));
+	pthread_mutex_init(&d->lock, NULL);
+
+	if (access(path, F_OK) == 0) {
+		struct hb_stream_reader *s = hb_stream_reader_from_file(NULL, path);
+
+		if (s->len < 8 || hb_stream_reader_uint32(s) != HB_DEDUP_MAGIC ||
+				hb_stream_reader_uint32(s) != HB_DEDUP_VERSION) {
+			hb_stream_reader_free(s);
+			return false;
+		}
+
+		// A record cut short by a crash is dropped, it gets appended again.
+		while (s->len - s->offset >= 16) {
+			struct hb_fingerprint fp;
+			fp.lo = hb_stream_reader_uint64(s);
+			fp.hi = hb_stream_reader_uint64(s);
+			hb_dedup_insert(d, fp);
+		}
+
+		bool torn = s->offset < s->len;
+		off_t end = (off_t) s->offset;
+		hb_stream_reader_free(s);
+		if (torn && truncate(path, end) == -1) return false;
+		d->fp = fopen(path, "ab");
+	} else if ((d->fp = fopen(path, "wb")) != NULL) {
+		struct hb_buf b = {0};
+		hb_buf_put_uint32(&b, HB_DEDUP_MAGIC);
+		hb_buf_put_uint32(&b, HB_DEDUP_VERSION);
+		fwrite(b.data, 1, b.len, d->fp);
+		fflush(d->fp);
+		hb_buf_free(&b);
+	}
+
+	return d->fp != NULL;
+}
+
+bool hb_dedup_check(struct hb_dedup *d, struct hb_fingerprint fp)
+{
+	bool seen;
+
+	pthread_mutex_lock(&d->lock);
+	seen = !hb_dedup_insert(d, fp);
+	if (seen) d->hits += 1;
+	pthread_mutex_unlock(&d->lock);
+
+	return seen;
+}
+
+void hb_dedup_commit(struct hb_dedup *d, struct hb_fingerprint fp)
+{
+	struct hb_buf b = {0};
+
+	hb_buf_put_uint64(&b, fp.lo);
+	hb_buf_put_uint64(&b, fp.hi);
+
+	pthread_mutex_lock(&d->lock);
+	fwrite(b.data, 1, b.len, d->fp);
+	fflush(d->fp);
+	d->misses += 1;
+	pthread_mutex_unlock(&d->lock);
+
+	hb_buf_free(&b);
+}
+
+void hb_dedup_close(struct hb_dedup *d)
+{
+	if (d->fp) fclose(d->fp);
+	free(d->slots);
+	pthread_mutex_destroy(&d->lock);
+	memset(d, 0, sizeof(*d));
+}
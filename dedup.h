@@ -0,0 +1,55 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define HB_DEDUP_MAGIC (0x48424444)
+#define HB_DEDUP_VERSION (1)
+
+// 128 bits of the file as uploaded, the compressed body is hashed as is so
+// a duplicate costs a read and no inflate. A zero fingerprint marks an
+// empty slot and is never returned.
+struct hb_fingerprint
+{
+	uint64_t lo, hi;
+};
+
+// Fingerprints of every replay seen so far. The file holds them after a
+// small header, big endian; new ones are appended (and flushed) once their
+// replay has been dumped, one that failed is tried again on the next run.
+struct hb_dedup
+{
+	struct hb_fingerprint *slots;
+	size_t length, cap;
+	FILE *fp;
+	size_t hits, misses;
+	pthread_mutex_t lock;
+};
+
+struct hb_fingerprint hb_fingerprint(const void *data, size_t len);
+
+bool hb_dedup_open(struct hb_dedup *d, const char *path);
+// Returns true if `fp` was already seen, otherwise claims it for this run
+// so a second copy is skipped meanwhile. Safe to call from several threads.
+bool hb_dedup_check(struct hb_dedup *d, struct hb_fingerprint fp);
+// Records a claimed fingerprint in the file, once its replay is dumped.
+void hb_dedup_commit(struct hb_dedup *d, struct hb_fingerprint fp);
+void hb_dedup_close(struct hb_dedup *d);
@@ -41,19 +41,21 @@ enum hb_event_kind
 	HB_EVENT_SET_TEAM_SHIRT      =   17
 };
 
+#define HB_EVENT_KIND_COUNT (HB_EVENT_SET_TEAM_SHIRT + 1)
+
 struct hb_event
 {
 	uint32_t by_player;
 	uint8_t type;
 	union {
-		struct hb_event_player_join { uint32_t id; char name[128], country[5]; bool is_admin; } player_join;
+		struct hb_event_player_join { uint32_t id, name, country; bool is_admin; } player_join;
 		struct hb_event_player_leave { uint16_t id; bool kicked, ban; char reason[256]; } player_leave;
 		struct hb_event_player_chat { char message[256]; } player_chat;
 		struct hb_event_set_player_input { uint8_t input; } set_player_input;
 		struct hb_event_set_player_team { uint32_t id; enum hb_team team; } set_player_team;
 		struct hb_event_set_teams_lock { bool teams_lock; } set_teams_lock;
 		struct hb_event_set_game_setting { uint8_t setting_id; uint32_t setting_value; } set_game_setting;
-		struct hb_event_set_player_avatar { char avatar[10]; } set_player_avatar;
+		struct hb_event_set_player_avatar { uint32_t avatar; } set_player_avatar;
 		struct hb_event_set_player_admin { uint32_t id; bool is_admin; } set_player_admin;
 		struct hb_event_set_stadium { const char *default_stadium; struct hb_stadium stadium; } set_stadium;
 		struct hb_event_pause_resume_game { bool paused; } pause_resume_game;
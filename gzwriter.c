@@ -0,0 +1,181 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+// fopencookie()
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "gzwriter.h"
+
+#define HB_GZWRITER_OUT (256*1024)
+
+static void hb_gzwriter_deflate(struct hb_gzwriter *w, const uint8_t *data, size_t len, int flush)
+{
+	w->zs.next_in = (Bytef *) data;
+	w->zs.avail_in = (uInt) len;
+
+	do {
+		w->zs.next_out = w->out;
+		w->zs.avail_out = HB_GZWRITER_OUT;
+		int ret = deflate(&w->zs, flush);
+		assert(ret != Z_STREAM_ERROR);
+		(void) ret;
+		size_t have = HB_GZWRITER_OUT - w->zs.avail_out;
+		if (fwrite(w->out, 1, have, w->fp) != have) {
+			perror("gzip");
+			exit(1);
+		}
+	} while (w->zs.avail_out == 0);
+}
+
+static void *hb_gzwriter_work(void *arg)
+{
+	struct hb_gzwriter *w = arg;
+
+	pthread_mutex_lock(&w->lock);
+	for (;;) {
+		while (NULL == w->pending && !w->finish)
+			pthread_cond_wait(&w->full, &w->lock);
+		if (NULL == w->pending) break;
+
+		const uint8_t *data = w->pending;
+		size_t len = w->pending_len;
+		bool sync = w->pending_sync;
+		pthread_mutex_unlock(&w->lock);
+		hb_gzwriter_deflate(w, data, len, sync ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+		if (sync) fflush(w->fp);
+		pthread_mutex_lock(&w->lock);
+
+		w->pending = NULL;
+		pthread_cond_signal(&w->empty);
+	}
+	pthread_mutex_unlock(&w->lock);
+
+	hb_gzwriter_deflate(w, NULL, 0, Z_FINISH);
+	fflush(w->fp);
+	return NULL;
+}
+
+bool hb_gzwriter_open(struct hb_gzwriter *w, FILE *fp, int level)
+{
+	memset(w, 0, sizeof(*w));
+	w->fp = fp;
+
+	// 16 + 15: the default window with a gzip header and trailer.
+	if (deflateInit2(&w->zs, level, Z_DEFLATED, 16 + 15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return false;
+
+	w->blocks[0] = malloc(HB_GZWRITER_BLOCK);
+	w->blocks[1] = malloc(HB_GZWRITER_BLOCK);
+	w->out = malloc(HB_GZWRITER_OUT);
+	assert(w->blocks[0] != NULL && w->blocks[1] != NULL && w->out != NULL);
+
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->full, NULL);
+	pthread_cond_init(&w->empty, NULL);
+	if (pthread_create(&w->thread, NULL, hb_gzwriter_work, w) != 0) {
+		perror("pthread_create");
+		exit(1);
+	}
+	return true;
+}
+
+// Waits for the thread to be done with the other block, then swaps.
+static void hb_gzwriter_hand_off(struct hb_gzwriter *w, bool sync)
+{
+	pthread_mutex_lock(&w->lock);
+	while (w->pending != NULL)
+		pthread_cond_wait(&w->empty, &w->lock);
+	w->pending = w->blocks[w->active];
+	w->pending_len = w->fill;
+	w->pending_sync = sync;
+	pthread_cond_signal(&w->full);
+	pthread_mutex_unlock(&w->lock);
+
+	w->active ^= 1;
+	w->fill = 0;
+}
+
+void hb_gzwriter_write(struct hb_gzwriter *w, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	while (len > 0) {
+		size_t n = HB_GZWRITER_BLOCK - w->fill;
+		if (n > len) n = len;
+		memcpy(&w->blocks[w->active][w->fill], p, n);
+		w->fill += n;
+		p += n;
+		len -= n;
+		if (w->fill == HB_GZWRITER_BLOCK) hb_gzwriter_hand_off(w, false);
+	}
+}
+
+void hb_gzwriter_flush(struct hb_gzwriter *w)
+{
+	hb_gzwriter_hand_off(w, true);
+
+	pthread_mutex_lock(&w->lock);
+	while (w->pending != NULL)
+		pthread_cond_wait(&w->empty, &w->lock);
+	pthread_mutex_unlock(&w->lock);
+}
+
+void hb_gzwriter_close(struct hb_gzwriter *w)
+{
+	if (w->fill > 0) hb_gzwriter_hand_off(w, false);
+
+	pthread_mutex_lock(&w->lock);
+	w->finish = true;
+	pthread_cond_signal(&w->full);
+	pthread_mutex_unlock(&w->lock);
+	pthread_join(w->thread, NULL);
+
+	deflateEnd(&w->zs);
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->full);
+	pthread_cond_destroy(&w->empty);
+	free(w->blocks[0]);
+	free(w->blocks[1]);
+	free(w->out);
+}
+
+static ssize_t hb_gzwriter_cookie_write(void *cookie, const char *data, size_t len)
+{
+	hb_gzwriter_write(cookie, data, len);
+	return (ssize_t) len;
+}
+
+static int hb_gzwriter_cookie_close(void *cookie)
+{
+	hb_gzwriter_close(cookie);
+	return 0;
+}
+
+FILE *hb_gzwriter_fopen(struct hb_gzwriter *w)
+{
+	cookie_io_functions_t io = {
+		.write = hb_gzwriter_cookie_write,
+		.close = hb_gzwriter_cookie_close
+	};
+	return fopencookie(w, "w", io);
+}
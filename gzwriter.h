@@ -0,0 +1,56 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <zlib.h>
+
+// Text is gathered in blocks of this size, one is filled while the writer
+// thread compresses the other.
+#define HB_GZWRITER_BLOCK (1024*1024)
+
+// Gzip stream written to `fp` by a thread of its own. Writes come from a
+// single producer and only block while both blocks are busy.
+struct hb_gzwriter
+{
+	FILE *fp;
+	z_stream zs;
+	uint8_t *blocks[2], *out;
+	size_t active, fill;
+	// Block handed to the thread, NULL once it is compressed.
+	const uint8_t *pending;
+	size_t pending_len;
+	bool pending_sync, finish;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t full, empty;
+};
+
+bool hb_gzwriter_open(struct hb_gzwriter *w, FILE *fp, int level);
+void hb_gzwriter_write(struct hb_gzwriter *w, const void *data, size_t len);
+// Compresses everything written so far and ends it with a sync flush, so a
+// reader can decompress up to here before the stream is closed. Returns
+// once it has reached `fp`.
+void hb_gzwriter_flush(struct hb_gzwriter *w);
+// Compresses what is left and ends the gzip stream, `fp` stays open.
+void hb_gzwriter_close(struct hb_gzwriter *w);
+// A stdio stream over the writer, fclose() closes the writer as well. There
+// is no flush hook for such a stream: fflush() it, then hb_gzwriter_flush().
+FILE *hb_gzwriter_fopen(struct hb_gzwriter *w);
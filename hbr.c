@@ -28,19 +28,31 @@
 #include <hb/disc.h>
 #include <hb/shirt.h>
 #include <hb/stadium.h>
+#include "arena.h"
+#include "intern.h"
 #include "player.h"
 #include "stream_reader.h"
 #include "events.h"
+#include "pack.h"
+#include "schema.h"
 #include "hbr.h"
 
-static enum hb_team hb_stream_reader_team(struct hb_stream_reader *s)
+// Decoders of one replay version, see schema.h.
+struct hbr_codec
 {
-	// FIXME: this is not ok, seems like team id is parsed in different ways
-	switch (hb_stream_reader_uint8(s)) {
-	case 0:  return HB_TEAM_BLUE;
-	case 1:  return HB_TEAM_RED;
-	default: return HB_TEAM_SPECTATOR;
-	}
+	uint32_t version;
+	const enum hb_team *teams;
+	size_t team_count;
+	void (*header)(struct hbr *hbr, struct hb_stream_reader *s);
+	void (*player)(const struct hbr_codec *codec, struct hb_stream_reader *s,
+			struct hb_player *player);
+};
+
+static enum hb_team hb_stream_reader_team(struct hb_stream_reader *s,
+		const struct hbr_codec *codec)
+{
+	uint8_t id = hb_stream_reader_uint8(s);
+	return id < codec->team_count ? codec->teams[id] : HB_TEAM_SPECTATOR;
 }
 
 static double hb_stream_reader_curve(struct hb_stream_reader *s)
@@ -68,13 +80,13 @@ static void hb_stream_reader_disc(struct hb_stream_reader *s,
 }
 
 static void hb_stream_reader_goal(struct hb_stream_reader *s,
-		struct hb_goal *goal)
+		const struct hbr_codec *codec, struct hb_goal *goal)
 {
 	goal->p0.x               = hb_stream_reader_double(s);
 	goal->p0.y               = hb_stream_reader_double(s);
 	goal->p1.x               = hb_stream_reader_double(s);
 	goal->p1.y               = hb_stream_reader_double(s);
-	goal->team               = hb_stream_reader_team(s);
+	goal->team               = hb_stream_reader_team(s, codec);
 }
 
 static void hb_stream_reader_plane(struct hb_stream_reader *s,
@@ -136,30 +148,6 @@ static void hb_stream_reader_player_physics(struct hb_stream_reader *s,
 	pp->radius               = 15.0;
 }
 
-static void hb_stream_reader_player(struct hb_stream_reader *s,
-		uint32_t version, struct hb_player *player)
-{
-	player->id               = hb_stream_reader_uint32(s);
-
-	hb_stream_reader_string_ascii_auto(s, player->name);
-
-	player->is_admin         = hb_stream_reader_bool(s);
-	player->team             = hb_stream_reader_team(s);
-	player->number           = hb_stream_reader_uint8(s);
-
-	hb_stream_reader_string_ascii_auto(s, player->avatar);
-
-	player->input            = hb_stream_reader_uint32(s);
-	player->kicking          = hb_stream_reader_uint8(s);
-	player->desynced         = hb_stream_reader_uint8(s);
-
-	hb_stream_reader_string_ascii_auto(s, player->country);
-
-	player->handicap         = version >= 11 ? hb_stream_reader_uint16(s) : 0;
-	player->disc_id          = hb_stream_reader_uint32(s);
-}
-
-
 static struct hb_shirt hb_stream_reader_shirt(struct hb_stream_reader *s)
 {
 	struct hb_shirt shirt;
@@ -168,7 +156,10 @@ static struct hb_shirt hb_stream_reader_shirt(struct hb_stream_reader *s)
 	shirt.avatar_color      = hb_stream_reader_uint32(s);
 	shirt.num_colors        = hb_stream_reader_uint8(s);
 
-	assert(shirt.num_colors <= 3);
+	if (shirt.num_colors > 3) {
+		hb_stream_reader_fail(s);
+		shirt.num_colors = 0;
+	}
 
 	for (size_t i = 0; i < shirt.num_colors; ++i) {
 		shirt.colors[i] = hb_stream_reader_uint32(s);
@@ -180,7 +171,10 @@ static struct hb_shirt hb_stream_reader_shirt(struct hb_stream_reader *s)
 static void hb_stream_reader_vertex_list(struct hb_stream_reader *s,
 		size_t count, struct hb_vertex_list *list)
 {
-	assert(list->length + count <= HB_VERTEX_LIST_MAX_VERTEXES);
+	if (list->length + count > HB_VERTEX_LIST_MAX_VERTEXES) {
+		hb_stream_reader_fail(s);
+		return;
+	}
 	while (count-- > 0)
 		hb_stream_reader_vertex(s, &list->vertexes[list->length++]);
 }
@@ -188,7 +182,10 @@ static void hb_stream_reader_vertex_list(struct hb_stream_reader *s,
 static void hb_stream_reader_segment_list(struct hb_stream_reader *s,
 		size_t count, struct hb_segment_list *list)
 {
-	assert(list->length + count <= HB_SEGMENT_LIST_MAX_SEGMENTS);
+	if (list->length + count > HB_SEGMENT_LIST_MAX_SEGMENTS) {
+		hb_stream_reader_fail(s);
+		return;
+	}
 	while (count-- > 0)
 		hb_stream_reader_segment(s, &list->segments[list->length++]);
 }
@@ -196,37 +193,49 @@ static void hb_stream_reader_segment_list(struct hb_stream_reader *s,
 static void hb_stream_reader_plane_list(struct hb_stream_reader *s,
 		size_t count, struct hb_plane_list *list)
 {
-	assert(list->length + count <= HB_PLANE_LIST_MAX_PLANES);
+	if (list->length + count > HB_PLANE_LIST_MAX_PLANES) {
+		hb_stream_reader_fail(s);
+		return;
+	}
 	while (count-- > 0)
 		hb_stream_reader_plane(s, &list->planes[list->length++]);
 }
 
 static void hb_stream_reader_goal_list(struct hb_stream_reader *s,
-		size_t count, struct hb_goal_list *list)
+		const struct hbr_codec *codec, size_t count, struct hb_goal_list *list)
 {
-	assert(list->length + count <= HB_GOAL_LIST_MAX_GOALS);
+	if (list->length + count > HB_GOAL_LIST_MAX_GOALS) {
+		hb_stream_reader_fail(s);
+		return;
+	}
 	while (count-- > 0)
-		hb_stream_reader_goal(s, &list->goals[list->length++]);
+		hb_stream_reader_goal(s, codec, &list->goals[list->length++]);
 }
 
 static void hb_stream_reader_disc_list(struct hb_stream_reader *s,
 		size_t count, struct hb_disc_list *list)
 {
-	assert(list->length + count <= HB_DISC_LIST_MAX_DISCS);
+	if (list->length + count > HB_DISC_LIST_MAX_DISCS) {
+		hb_stream_reader_fail(s);
+		return;
+	}
 	while (count-- > 0)
 		hb_stream_reader_disc(s, &list->discs[list->length++]);
 }
 
 static void hb_stream_reader_player_list(struct hb_stream_reader *s,
-		uint32_t version, size_t count, struct hb_player_list *list)
+		const struct hbr_codec *codec, size_t count, struct hb_player_list *list)
 {
-	assert(list->length + count <= HB_PLAYER_LIST_MAX_PLAYERS);
+	if (list->length + count > HB_PLAYER_LIST_MAX_PLAYERS) {
+		hb_stream_reader_fail(s);
+		return;
+	}
 	while (count-- > 0)
-		hb_stream_reader_player(s, version, &list->players[list->length++]);
+		codec->player(codec, s, &list->players[list->length++]);
 }
 
 static void hb_stream_reader_stadium(struct hb_stream_reader *s,
-		const char **default_stadium, struct hb_stadium *stadium)
+		const struct hbr_codec *codec, const char **default_stadium, struct hb_stadium *stadium)
 {
 	static const char *default_stadium_names[] = {
 		"Classic", "Easy", "Small",
@@ -257,7 +266,7 @@ static void hb_stream_reader_stadium(struct hb_stream_reader *s,
 	hb_stream_reader_vertex_list(s, hb_stream_reader_uint8(s), &stadium->vertex_list);
 	hb_stream_reader_segment_list(s, hb_stream_reader_uint8(s), &stadium->segment_list);
 	hb_stream_reader_plane_list(s, hb_stream_reader_uint8(s), &stadium->plane_list);
-	hb_stream_reader_goal_list(s, hb_stream_reader_uint8(s), &stadium->goal_list);
+	hb_stream_reader_goal_list(s, codec, hb_stream_reader_uint8(s), &stadium->goal_list);
 	hb_stream_reader_disc_list(s, hb_stream_reader_uint8(s), &stadium->disc_list);
 	hb_stream_reader_player_physics(s, &stadium->player_physics);
 	struct hb_disc *ball_physics = &stadium->disc_list.discs[0];
@@ -265,52 +274,135 @@ static void hb_stream_reader_stadium(struct hb_stream_reader *s,
 	ball_physics->c_group |= HB_COLLISION_KICK|HB_COLLISION_SCORE|HB_COLLISION_BALL;
 }
 
+#define HBR_DECODE_uint8(s, obj, field)   (obj)->field = hb_stream_reader_uint8(s)
+#define HBR_DECODE_uint16(s, obj, field)  (obj)->field = hb_stream_reader_uint16(s)
+#define HBR_DECODE_uint32(s, obj, field)  (obj)->field = hb_stream_reader_uint32(s)
+#define HBR_DECODE_double(s, obj, field)  (obj)->field = hb_stream_reader_double(s)
+#define HBR_DECODE_boolean(s, obj, field) (obj)->field = hb_stream_reader_bool(s)
+#define HBR_DECODE_interned(s, obj, field) (obj)->field = hb_stream_reader_intern(s)
+#define HBR_DECODE_team(s, obj, field)    (obj)->field = hb_stream_reader_team(s, codec)
+#define HBR_DECODE_shirt(s, obj, field)   (obj)->field = hb_stream_reader_shirt(s)
+#define HBR_DECODE_stadium(s, obj, field) \
+	hb_stream_reader_stadium(s, codec, &(obj)->default_stadium, &(obj)->field)
+#define HBR_DECODE_players(s, obj, field) \
+	hb_stream_reader_player_list(s, codec, hb_stream_reader_uint32(s), &(obj)->field)
+#define HBR_DECODE_game(s, obj, field) do { \
+	(obj)->in_progress = hb_stream_reader_bool(s); \
+	if ((obj)->in_progress) \
+		hb_stream_reader_disc_list(s, hb_stream_reader_uint32(s), &(obj)->field); \
+} while (0)
+
+// VERSION is a constant in every instantiated decoder, the range checks of
+// absent fields fold away at compile time.
+#define HBR_DECODE_FIELD(obj, field, kind, since, until) \
+	if (VERSION >= (since) && VERSION <= (until)) HBR_DECODE_##kind(s, obj, field);
+#define HBR_DECODE_HEADER_FIELD(field, kind, since, until) \
+	HBR_DECODE_FIELD(hbr, field, kind, since, until)
+#define HBR_DECODE_PLAYER_FIELD(field, kind, since, until) \
+	HBR_DECODE_FIELD(player, field, kind, since, until)
+
+#define HBR_DEFINE_CODEC(v, team_table) \
+	static const enum hb_team hbr_teams_v##v[] = team_table; \
+	static const struct hbr_codec hbr_codec_v##v; \
+	static void hbr_decode_player_v##v(const struct hbr_codec *codec, \
+			struct hb_stream_reader *s, struct hb_player *player) \
+	{ \
+		enum { VERSION = v }; \
+		HBR_PLAYER_SCHEMA(HBR_DECODE_PLAYER_FIELD) \
+	} \
+	static void hbr_decode_header_v##v(struct hbr *hbr, struct hb_stream_reader *s) \
+	{ \
+		enum { VERSION = v }; \
+		const struct hbr_codec *codec = &hbr_codec_v##v; \
+		HBR_HEADER_SCHEMA(HBR_DECODE_HEADER_FIELD) \
+	} \
+	static const struct hbr_codec hbr_codec_v##v = { \
+		.version = v, \
+		.teams = hbr_teams_v##v, \
+		.team_count = sizeof(hbr_teams_v##v) / sizeof(hbr_teams_v##v[0]), \
+		.header = hbr_decode_header_v##v, \
+		.player = hbr_decode_player_v##v \
+	};
+
+HBR_VERSIONS(HBR_DEFINE_CODEC)
+
+#define HBR_CODEC_ENTRY(v, team_table) &hbr_codec_v##v,
+
+static const struct hbr_codec *hbr_codecs[] = { HBR_VERSIONS(HBR_CODEC_ENTRY) };
+
+static const struct hbr_codec *hbr_codec_find(uint32_t version)
+{
+	for (size_t i = 0; i < sizeof(hbr_codecs) / sizeof(hbr_codecs[0]); ++i)
+		if (hbr_codecs[i]->version == version)
+			return hbr_codecs[i];
+	return NULL;
+}
+
+static struct hbr *hbr_parse_stream(struct hbr *hbr, struct hb_stream_reader *s);
+
 struct hbr *hbr_parse(const char *path)
 {
-	struct hbr *hbr = calloc(1, sizeof(*hbr));
-	struct hb_stream_reader *s = hbr->stream = hb_stream_reader_from_file(path);
+	return hbr_parse_arena(path, NULL);
+}
 
-	hbr->version            = hb_stream_reader_uint32(s);
-	assert(hbr->version >= HBR_MIN_VERSION && hbr->version <= HBR_MAX_VERSION);
+struct hbr *hbr_parse_arena(const char *path, struct hb_arena *arena)
+{
+	struct hbr *hbr = arena ? hb_arena_calloc(arena, sizeof(*hbr)) : calloc(1, sizeof(*hbr));
+	assert(hbr != NULL);
+	hbr->arena = arena;
+	return hbr_parse_stream(hbr, hb_stream_reader_from_file(arena, path));
+}
 
-	hbr->magic              = hb_stream_reader_uint32(s);
-	assert(hbr->magic == HBR_MAGIC);
+struct hbr *hbr_parse_buffer(uint8_t *data, size_t len, struct hb_arena *arena)
+{
+	struct hbr *hbr = hb_arena_calloc(arena, sizeof(*hbr));
+	hbr->arena = arena;
+	return hbr_parse_stream(hbr, hb_stream_reader_from_buffer(arena, data, len));
+}
 
-	hbr->total_frames       = hb_stream_reader_uint32(s);
+static struct hbr *hbr_parse_stream(struct hbr *hbr, struct hb_stream_reader *s)
+{
+	hbr->stream = s;
 
-	hb_stream_reader_inflate(s, false);
+	if (hbr_pack_probe(s->data, s->len)) {
+		hbr->pack = hbr_pack_open(s, hbr->arena);
+		if (NULL == hbr->pack || NULL == (hbr->codec = hbr_codec_find(hbr->pack->version))) {
+			hbr_free(hbr);
+			return NULL;
+		}
+		hbr->version = hbr->pack->version;
+		hbr->magic = HBR_MAGIC;
+		hbr->total_frames = hbr->pack->total_frames;
+		hbr->codec->header(hbr, &hbr->pack->header);
+		if (hbr->pack->header.failed) {
+			hbr_free(hbr);
+			return NULL;
+		}
+		hbr->stream = &hbr->pack->block;
+		return hbr;
+	}
 
-	hbr->start_frame        = hb_stream_reader_uint32(s);
+	if (s->len < 12) {
+		hbr_free(hbr);
+		return NULL;
+	}
 
-	hb_stream_reader_string_ascii_auto(s, hbr->room_name);
+	hbr->version            = hb_stream_reader_uint32(s);
+	hbr->codec              = hbr_codec_find(hbr->version);
+	hbr->magic              = hb_stream_reader_uint32(s);
+	hbr->total_frames       = hb_stream_reader_uint32(s);
 
-	hbr->teams_lock         = hb_stream_reader_bool(s);
-	hbr->score_limit        = hb_stream_reader_uint8(s);
-	hbr->time_limit         = hb_stream_reader_uint8(s);
-	hbr->rules_timer        = hb_stream_reader_uint32(s);
-	hbr->kick_off_taken     = hb_stream_reader_uint8(s);
-	hbr->kick_off_team      = hb_stream_reader_uint8(s);
-	hbr->ball_x             = hb_stream_reader_double(s);
-	hbr->ball_y             = hb_stream_reader_double(s);
-	hbr->score_red          = hb_stream_reader_uint32(s);
-	hbr->score_blue         = hb_stream_reader_uint32(s);
-	hbr->match_time         = hb_stream_reader_double(s);
-	hbr->pause_timer        = hb_stream_reader_uint8(s);
+	if (NULL == hbr->codec || hbr->magic != HBR_MAGIC || !hb_stream_reader_try_inflate(s, false)) {
+		hbr_free(hbr);
+		return NULL;
+	}
 
-	hb_stream_reader_stadium(s, &hbr->default_stadium,
-			&hbr->stadium);
+	hbr->codec->header(hbr, s);
 
-	hbr->in_progress = hb_stream_reader_bool(s);
-	if (hbr->in_progress) {
-		hb_stream_reader_disc_list(s, hb_stream_reader_uint32(s),
-				&hbr->in_game_disc_list);
+	if (s->failed) {
+		hbr_free(hbr);
+		return NULL;
 	}
-	hb_stream_reader_player_list(s, hbr->version, hb_stream_reader_uint32(s),
-			&hbr->player_list);
-	if (hbr->version < 12)
-		return hbr;
-	hbr->red_shirt = hb_stream_reader_shirt(s);
-	hbr->blue_shirt = hb_stream_reader_shirt(s);
 
 	return hbr;
 }
@@ -318,9 +410,9 @@ struct hbr *hbr_parse(const char *path)
 static void parse_event_player_join(struct hb_stream_reader *s, struct hb_event *ev)
 {
 	ev->player_join.id = hb_stream_reader_uint32(s);
-	hb_stream_reader_string_ascii_auto(s, ev->player_join.name);
+	ev->player_join.name = hb_stream_reader_intern(s);
 	ev->player_join.is_admin = hb_stream_reader_bool(s);
-	hb_stream_reader_string_ascii_auto(s, ev->player_join.country);
+	ev->player_join.country = hb_stream_reader_intern(s);
 }
 
 static void parse_event_player_leave(struct hb_stream_reader *s, struct hb_event *ev)
@@ -342,10 +434,11 @@ static void parse_event_set_player_input(struct hb_stream_reader *s, struct hb_e
 	ev->set_player_input.input = hb_stream_reader_uint8(s);
 }
 
-static void parse_event_set_player_team(struct hb_stream_reader *s, struct hb_event *ev)
+static void parse_event_set_player_team(const struct hbr_codec *codec, struct hb_stream_reader *s,
+		struct hb_event *ev)
 {
 	ev->set_player_team.id = hb_stream_reader_uint32(s);
-	ev->set_player_team.team = hb_stream_reader_team(s);
+	ev->set_player_team.team = hb_stream_reader_team(s, codec);
 }
 
 static void parse_event_set_teams_lock(struct hb_stream_reader *s, struct hb_event *ev)
@@ -361,7 +454,7 @@ static void parse_event_set_game_setting(struct hb_stream_reader *s, struct hb_e
 
 static void parse_event_set_player_avatar(struct hb_stream_reader *s, struct hb_event *ev)
 {
-	hb_stream_reader_string_ascii_auto(s, ev->set_player_avatar.avatar);
+	ev->set_player_avatar.avatar = hb_stream_reader_intern(s);
 }
 
 static void parse_event_set_player_admin(struct hb_stream_reader *s, struct hb_event *ev)
@@ -370,15 +463,26 @@ static void parse_event_set_player_admin(struct hb_stream_reader *s, struct hb_e
 	ev->set_player_admin.is_admin = hb_stream_reader_bool(s);
 }
 
-static void parse_event_set_stadium(struct hb_stream_reader *s, struct hb_event *ev)
+static void parse_event_set_stadium(const struct hbr_codec *codec, struct hb_stream_reader *s,
+		struct hb_event *ev)
 {
 	uint32_t chunk_size = hb_stream_reader_uint32(s);
 	struct hb_stream_reader *stadium_stream = hb_stream_reader_slice(s, chunk_size);
 	hb_stream_reader_inflate(stadium_stream, true);
-	hb_stream_reader_stadium(stadium_stream, &ev->set_stadium.default_stadium, &ev->set_stadium.stadium);
+	hb_stream_reader_stadium(stadium_stream, codec, &ev->set_stadium.default_stadium, &ev->set_stadium.stadium);
+	if (stadium_stream->failed) hb_stream_reader_fail(s);
 	hb_stream_reader_free(stadium_stream);
 }
 
+static void parse_event_set_stadium_packed(const struct hbr_codec *codec, struct hbr_pack *pack,
+		struct hb_stream_reader *s, struct hb_event *ev)
+{
+	struct hb_stream_reader *stadium_stream = hbr_pack_stadium(pack, hb_stream_reader_uint32(s));
+	if (NULL == stadium_stream) hb_stream_reader_fail(s);
+	else hb_stream_reader_stadium(stadium_stream, codec, &ev->set_stadium.default_stadium, &ev->set_stadium.stadium);
+	if (stadium_stream && stadium_stream->failed) hb_stream_reader_fail(s);
+}
+
 static void parse_event_pause_resume_game(struct hb_stream_reader *s, struct hb_event *ev)
 {
 	ev->pause_resume_game.paused = hb_stream_reader_bool(s);
@@ -396,11 +500,15 @@ static void parse_event_set_player_handicap(struct hb_stream_reader *s, struct h
 	ev->set_player_handicap.handicap = hb_stream_reader_uint16(s);
 }
 
-static void parse_event_set_team_shirt(struct hb_stream_reader *s, struct hb_event *ev)
+static void parse_event_set_team_shirt(const struct hbr_codec *codec, struct hb_stream_reader *s,
+		struct hb_event *ev)
 {
-	ev->set_team_shirt.team = hb_stream_reader_team(s);
+	ev->set_team_shirt.team = hb_stream_reader_team(s, codec);
 	ev->set_team_shirt.shirt.num_colors = (size_t) hb_stream_reader_uint8(s);
-	assert(ev->set_team_shirt.shirt.num_colors <= 3);
+	if (ev->set_team_shirt.shirt.num_colors > 3) {
+		hb_stream_reader_fail(s);
+		return;
+	}
 	for (size_t i = 0; i < ev->set_team_shirt.shirt.num_colors; ++i)
 		ev->set_team_shirt.shirt.colors[i] = hb_stream_reader_uint32(s);
 	ev->set_team_shirt.shirt.angle = (double) hb_stream_reader_uint16(s);
@@ -411,27 +519,33 @@ int hbr_next_event(struct hbr *hbr, struct hb_event *ev)
 {
 	struct hb_stream_reader *s = hbr->stream;
 
-	if (s->offset >= s->len) return 0;
+	if (s->failed || (s->offset >= s->len && (NULL == hbr->pack || !hbr_pack_next_block(hbr->pack))))
+		return 0;
 	if (hb_stream_reader_bool(s)) hbr->current_frame += hb_stream_reader_uint32(s);
 
 	ev->by_player = hb_stream_reader_uint32(s);
 	ev->type = hb_stream_reader_uint8(s);
+	hbr->event_offset = s->offset;
+	if (ev->type < HB_EVENT_KIND_COUNT) hbr->event_counts[ev->type] += 1;
 
 	switch (ev->type) {
 	case HB_EVENT_PLAYER_JOIN: parse_event_player_join(s, ev); break;
 	case HB_EVENT_PLAYER_LEAVE: parse_event_player_leave(s, ev); break;
 	case HB_EVENT_PLAYER_CHAT: parse_event_player_chat(s, ev); break;
 	case HB_EVENT_SET_PLAYER_INPUT: parse_event_set_player_input(s, ev); break;
-	case HB_EVENT_SET_PLAYER_TEAM: parse_event_set_player_team(s, ev); break;
+	case HB_EVENT_SET_PLAYER_TEAM: parse_event_set_player_team(hbr->codec, s, ev); break;
 	case HB_EVENT_SET_TEAMS_LOCK: parse_event_set_teams_lock(s, ev); break;
 	case HB_EVENT_SET_GAME_SETTING: parse_event_set_game_setting(s, ev); break;
 	case HB_EVENT_SET_PLAYER_AVATAR: parse_event_set_player_avatar(s, ev); break;
 	case HB_EVENT_SET_PLAYER_ADMIN: parse_event_set_player_admin(s, ev); break;
-	case HB_EVENT_SET_STADIUM: parse_event_set_stadium(s, ev); break;
+	case HB_EVENT_SET_STADIUM:
+		if (hbr->pack) parse_event_set_stadium_packed(hbr->codec, hbr->pack, s, ev);
+		else parse_event_set_stadium(hbr->codec, s, ev);
+		break;
 	case HB_EVENT_PAUSE_RESUME_GAME: parse_event_pause_resume_game(s, ev); break;
 	case HB_EVENT_PING_UPDATE: parse_event_ping_update(s, ev); break;
 	case HB_EVENT_SET_PLAYER_HANDICAP: parse_event_set_player_handicap(s, ev); break;
-	case HB_EVENT_SET_TEAM_SHIRT: parse_event_set_team_shirt(s, ev); break;
+	case HB_EVENT_SET_TEAM_SHIRT: parse_event_set_team_shirt(hbr->codec, s, ev); break;
 
 	case HB_EVENT_SET_PLAYER_DESYNC: /* No data */ break;
 	case HB_EVENT_LOGIC_UPDATE: /* No data */ break;
@@ -440,11 +554,397 @@ int hbr_next_event(struct hbr *hbr, struct hb_event *ev)
 	default: return 0;
 	}
 
-	return 1;
+	return !s->failed;
+}
+
+static struct hb_player *hbr_player(struct hbr *hbr, uint32_t id)
+{
+	int index = hb_player_list_index_of(&hbr->player_list, id);
+	return index == -1 ? NULL : &hbr->player_list.players[index];
+}
+
+static void visit_player_join(struct hbr *hbr, struct hb_stream_reader *s, struct hbr_visit *v)
+{
+	struct hb_player_list *list = &hbr->player_list;
+	if (list->length == HB_PLAYER_LIST_MAX_PLAYERS) {
+		hb_stream_reader_fail(s);
+		return;
+	}
+	struct hb_player *player = &list->players[list->length++];
+	memset(player, 0, sizeof(*player));
+	player->id = hb_stream_reader_uint32(s);
+	v->player_join.name = hb_stream_reader_string_view(s);
+	player->is_admin = hb_stream_reader_bool(s);
+	v->player_join.country = hb_stream_reader_string_view(s);
+	player->name = hb_intern(v->player_join.name.data, v->player_join.name.len);
+	player->country = hb_intern(v->player_join.country.data, v->player_join.country.len);
+	v->player_join.player = player;
+}
+
+// The player is removed from the table once the handler returns.
+static void visit_player_leave(struct hbr *hbr, struct hb_stream_reader *s, struct hbr_visit *v)
+{
+	v->player_leave.id = hb_stream_reader_uint16(s);
+	v->player_leave.player = hbr_player(hbr, v->player_leave.id);
+	v->player_leave.kicked = hb_stream_reader_bool(s);
+	v->player_leave.reason = (struct hb_str_view) { "", 0 };
+	if (v->player_leave.kicked) v->player_leave.reason = hb_stream_reader_string_view(s);
+	v->player_leave.ban = hb_stream_reader_bool(s);
+}
+
+static void visit_player_chat(struct hbr *hbr, struct hb_stream_reader *s, struct hbr_visit *v)
+{
+	(void) hbr;
+	v->player_chat.message = hb_stream_reader_string_view(s);
+}
+
+static void visit_set_player_input(struct hbr *hbr, struct hb_stream_reader *s, struct hbr_visit *v)
+{
+	(void) hbr;
+	v->set_player_input.input = hb_stream_reader_uint8(s);
+	if (v->player) v->player->input = v->set_player_input.input;
+}
+
+static void visit_set_player_team(struct hbr *hbr, struct hb_stream_reader *s, struct hbr_visit *v)
+{
+	v->set_player_team.player = hbr_player(hbr, hb_stream_reader_uint32(s));
+	v->set_player_team.team = hb_stream_reader_team(s, hbr->codec);
+	if (v->set_player_team.player) v->set_player_team.player->team = v->set_player_team.team;
+}
+
+static void visit_set_teams_lock(struct hbr *hbr, struct hb_stream_reader *s, struct hbr_visit *v)
+{
+	hbr->teams_lock = v->set_teams_lock.teams_lock = hb_stream_reader_bool(s);
+}
+
+static void visit_set_game_setting(struct hbr *hbr, struct hb_stream_reader *s, struct hbr_visit *v)
+{
+	(void) hbr;
+	v->set_game_setting.setting_id = hb_stream_reader_uint8(s);
+	v->set_game_setting.setting_value = hb_stream_reader_uint32(s);
+}
+
+static void visit_set_player_avatar(struct hbr *hbr, struct hb_stream_reader *s, struct hbr_visit *v)
+{
+	(void) hbr;
+	v->set_player_avatar.avatar = hb_stream_reader_string_view(s);
+	if (v->player) v->player->avatar = hb_intern(v->set_player_avatar.avatar.data, v->set_player_avatar.avatar.len);
+}
+
+static void visit_set_player_desync(struct hbr *hbr, struct hb_stream_reader *s, struct hbr_visit *v)
+{
+	(void) hbr; (void) s;
+	if (v->player) v->player->desynced = 1;
+}
+
+static void visit_set_player_admin(struct hbr *hbr, struct hb_stream_reader *s, struct hbr_visit *v)
+{
+	v->set_player_admin.player = hbr_player(hbr, hb_stream_reader_uint32(s));
+	v->set_player_admin.is_admin = hb_stream_reader_bool(s);
+	if (v->set_player_admin.player) v->set_player_admin.player->is_admin = v->set_player_admin.is_admin;
+}
+
+static void hbr_read_stadium(struct hbr *hbr, struct hb_stream_reader *s)
+{
+	if (hbr->pack) {
+		struct hb_stream_reader *stadium_stream = hbr_pack_stadium(hbr->pack, hb_stream_reader_uint32(s));
+		if (NULL == stadium_stream) hb_stream_reader_fail(s);
+		else hb_stream_reader_stadium(stadium_stream, hbr->codec, &hbr->default_stadium, &hbr->stadium);
+		if (stadium_stream && stadium_stream->failed) hb_stream_reader_fail(s);
+	} else {
+		struct hb_stream_reader *stadium_stream = hb_stream_reader_slice(s, hb_stream_reader_uint32(s));
+		hb_stream_reader_inflate(stadium_stream, true);
+		hb_stream_reader_stadium(stadium_stream, hbr->codec, &hbr->default_stadium, &hbr->stadium);
+		if (stadium_stream->failed) hb_stream_reader_fail(s);
+		hb_stream_reader_free(stadium_stream);
+	}
+}
+
+static void visit_set_stadium(struct hbr *hbr, struct hb_stream_reader *s, struct hbr_visit *v)
+{
+	hbr_read_stadium(hbr, s);
+	v->set_stadium.default_stadium = hbr->default_stadium;
+	v->set_stadium.stadium = &hbr->stadium;
+}
+
+static void visit_pause_resume_game(struct hbr *hbr, struct hb_stream_reader *s, struct hbr_visit *v)
+{
+	(void) hbr;
+	v->pause_resume_game.paused = hb_stream_reader_bool(s);
+}
+
+static void visit_ping_update(struct hbr *hbr, struct hb_stream_reader *s, struct hbr_visit *v)
+{
+	(void) hbr;
+	v->ping_update.ping_count = hb_stream_reader_uint8(s);
+	v->ping_update.pings = &s->data[s->offset];
+	hb_stream_reader_skip(s, v->ping_update.ping_count);
+}
+
+static void visit_set_player_handicap(struct hbr *hbr, struct hb_stream_reader *s, struct hbr_visit *v)
+{
+	(void) hbr;
+	v->set_player_handicap.handicap = hb_stream_reader_uint16(s);
+	if (v->player) v->player->handicap = v->set_player_handicap.handicap;
+}
+
+static void visit_set_team_shirt(struct hbr *hbr, struct hb_stream_reader *s, struct hbr_visit *v)
+{
+	struct hb_shirt *shirt;
+
+	v->set_team_shirt.team = hb_stream_reader_team(s, hbr->codec);
+	shirt = v->set_team_shirt.team == HB_TEAM_RED ? &hbr->red_shirt : &hbr->blue_shirt;
+	shirt->num_colors = (size_t) hb_stream_reader_uint8(s);
+	if (shirt->num_colors > 3) {
+		hb_stream_reader_fail(s);
+		shirt->num_colors = 0;
+		return;
+	}
+	for (size_t i = 0; i < shirt->num_colors; ++i)
+		shirt->colors[i] = hb_stream_reader_uint32(s);
+	shirt->angle = (double) hb_stream_reader_uint16(s);
+	shirt->avatar_color = hb_stream_reader_uint32(s);
+	v->set_team_shirt.shirt = shirt;
+}
+
+static void skip_none(struct hbr *hbr, struct hb_stream_reader *s)
+{
+	(void) hbr; (void) s;
+}
+
+static void skip_string(struct hbr *hbr, struct hb_stream_reader *s)
+{
+	(void) hbr;
+	hb_stream_reader_skip(s, hb_stream_reader_uint16(s));
+}
+
+static void skip_uint8(struct hbr *hbr, struct hb_stream_reader *s)
+{
+	(void) hbr;
+	hb_stream_reader_skip(s, 1);
+}
+
+static void skip_game_setting(struct hbr *hbr, struct hb_stream_reader *s)
+{
+	(void) hbr;
+	hb_stream_reader_skip(s, 1 + 4);
+}
+
+static void skip_stadium(struct hbr *hbr, struct hb_stream_reader *s)
+{
+	uint32_t size = hb_stream_reader_uint32(s);
+	if (NULL == hbr->pack) hb_stream_reader_skip(s, size);
+}
+
+static void skip_ping_update(struct hbr *hbr, struct hb_stream_reader *s)
+{
+	(void) hbr;
+	hb_stream_reader_skip(s, hb_stream_reader_uint8(s));
+}
+
+static void skip_team_shirt(struct hbr *hbr, struct hb_stream_reader *s)
+{
+	(void) hbr;
+	hb_stream_reader_skip(s, 1);
+	hb_stream_reader_skip(s, hb_stream_reader_uint8(s) * 4 + 2 + 4);
+}
+
+// Kinds without `skip` change the player table and are decoded even when
+// nobody visits them.
+static const struct {
+	void (*decode)(struct hbr *hbr, struct hb_stream_reader *s, struct hbr_visit *v);
+	void (*skip)(struct hbr *hbr, struct hb_stream_reader *s);
+} visit_kinds[HB_EVENT_KIND_COUNT] = {
+	[HB_EVENT_PLAYER_JOIN]         = { visit_player_join,         NULL },
+	[HB_EVENT_PLAYER_LEAVE]        = { visit_player_leave,        NULL },
+	[HB_EVENT_PLAYER_CHAT]         = { visit_player_chat,         skip_string },
+	[HB_EVENT_LOGIC_UPDATE]        = { NULL,                      skip_none },
+	[HB_EVENT_START_MATCH]         = { NULL,                      skip_none },
+	[HB_EVENT_STOP_MATCH]          = { NULL,                      skip_none },
+	[HB_EVENT_SET_PLAYER_INPUT]    = { visit_set_player_input,    NULL },
+	[HB_EVENT_SET_PLAYER_TEAM]     = { visit_set_player_team,     NULL },
+	[HB_EVENT_SET_TEAMS_LOCK]      = { visit_set_teams_lock,      skip_uint8 },
+	[HB_EVENT_SET_GAME_SETTING]    = { visit_set_game_setting,    skip_game_setting },
+	[HB_EVENT_SET_PLAYER_AVATAR]   = { visit_set_player_avatar,   NULL },
+	[HB_EVENT_SET_PLAYER_DESYNC]   = { visit_set_player_desync,   NULL },
+	[HB_EVENT_SET_PLAYER_ADMIN]    = { visit_set_player_admin,    NULL },
+	[HB_EVENT_SET_STADIUM]         = { visit_set_stadium,         skip_stadium },
+	[HB_EVENT_PAUSE_RESUME_GAME]   = { visit_pause_resume_game,   skip_uint8 },
+	[HB_EVENT_PING_UPDATE]         = { visit_ping_update,         skip_ping_update },
+	[HB_EVENT_SET_PLAYER_HANDICAP] = { visit_set_player_handicap, NULL },
+	[HB_EVENT_SET_TEAM_SHIRT]      = { visit_set_team_shirt,      skip_team_shirt }
+};
+
+size_t hbr_visit(struct hbr *hbr, const struct hbr_visitor *visitor)
+{
+	struct hbr_visit v;
+	size_t count = 0;
+
+	for (;;) {
+		struct hb_stream_reader *s = hbr->stream;
+
+		if (s->failed || (s->offset >= s->len && (NULL == hbr->pack || !hbr_pack_next_block(hbr->pack))))
+			break;
+		if (hb_stream_reader_bool(s)) hbr->current_frame += hb_stream_reader_uint32(s);
+
+		v.by_player = hb_stream_reader_uint32(s);
+		v.type = hb_stream_reader_uint8(s);
+		hbr->event_offset = s->offset;
+		if (v.type >= HB_EVENT_KIND_COUNT) break;
+		hbr->event_counts[v.type] += 1;
+		count += 1;
+
+		hbr_visit_fn fn = visitor->on[v.type];
+		if (NULL == fn && visit_kinds[v.type].skip) {
+			visit_kinds[v.type].skip(hbr, s);
+			continue;
+		}
+
+		v.player = hbr_player(hbr, v.by_player);
+		if (visit_kinds[v.type].decode) visit_kinds[v.type].decode(hbr, s, &v);
+		if (s->failed) break;
+		if (fn) fn(hbr, &v, visitor->data);
+		if (v.type == HB_EVENT_PLAYER_LEAVE) hb_player_list_remove(&hbr->player_list, v.player_leave.id);
+	}
+
+	return count;
+}
+
+static void hbr_split_push(struct hbr *hbr, struct hbr_split *split, size_t offset, uint32_t frame,
+		size_t stadium)
+{
+	if (split->length == split->cap) {
+		split->cap = split->cap ? split->cap * 2 : 16;
+		split->segments = realloc(split->segments, split->cap * sizeof(*split->segments));
+		assert(split->segments != NULL);
+	}
+	while (split->players_length + hbr->player_list.length > split->players_cap) {
+		split->players_cap = split->players_cap ? split->players_cap * 2 : 64;
+		split->players = realloc(split->players, split->players_cap * sizeof(*split->players));
+		split->player_strings = realloc(split->player_strings,
+				split->players_cap * sizeof(*split->player_strings));
+		assert(split->players != NULL && split->player_strings != NULL);
+	}
+
+	struct hbr_segment *seg = &split->segments[split->length++];
+	seg->offset = offset;
+	seg->frame = frame;
+	memcpy(seg->event_counts, hbr->event_counts, sizeof(seg->event_counts));
+	seg->teams_lock = hbr->teams_lock;
+	seg->red_shirt = hbr->red_shirt;
+	seg->blue_shirt = hbr->blue_shirt;
+	seg->stadium = stadium;
+	seg->first_player = split->players_length;
+	seg->player_count = hbr->player_list.length;
+	for (size_t i = 0; i < hbr->player_list.length; ++i) {
+		const struct hb_player *player = &hbr->player_list.players[i];
+		split->players[split->players_length] = *player;
+		split->player_strings[split->players_length][0] = hb_intern_str(player->name);
+		split->player_strings[split->players_length][1] = hb_intern_str(player->country);
+		split->player_strings[split->players_length][2] = hb_intern_str(player->avatar);
+		split->players_length += 1;
+	}
+}
+
+void hbr_split(struct hbr *hbr, size_t min_len, struct hbr_split *split)
+{
+	struct hb_stream_reader *s = hbr->stream;
+	struct hbr_visit v;
+	size_t stadium = 0;
+
+	assert(NULL == hbr->pack);
+	memset(split, 0, sizeof(*split));
+	split->room_name = hb_intern_str(hbr->room_name);
+	hbr_split_push(hbr, split, s->offset, hbr->current_frame, stadium);
+
+	while (s->offset < s->len) {
+		size_t start = s->offset;
+		uint32_t frame = hbr->current_frame;
+
+		if (hb_stream_reader_bool(s)) hbr->current_frame += hb_stream_reader_uint32(s);
+		v.by_player = hb_stream_reader_uint32(s);
+		v.type = hb_stream_reader_uint8(s);
+		hbr->event_offset = s->offset;
+		if (v.type >= HB_EVENT_KIND_COUNT) break;
+
+		if ((v.type == HB_EVENT_START_MATCH || v.type == HB_EVENT_STOP_MATCH) &&
+				start - split->segments[split->length - 1].offset >= min_len)
+			hbr_split_push(hbr, split, start, frame, stadium);
+		hbr->event_counts[v.type] += 1;
+		if (v.type == HB_EVENT_SET_STADIUM) stadium = s->offset;
+
+		// Shirts and the teams lock are room state here as well.
+		if (visit_kinds[v.type].skip && v.type != HB_EVENT_SET_TEAM_SHIRT &&
+				v.type != HB_EVENT_SET_TEAMS_LOCK) {
+			visit_kinds[v.type].skip(hbr, s);
+			continue;
+		}
+
+		v.player = hbr_player(hbr, v.by_player);
+		if (visit_kinds[v.type].decode) visit_kinds[v.type].decode(hbr, s, &v);
+		if (v.type == HB_EVENT_PLAYER_LEAVE) hb_player_list_remove(&hbr->player_list, v.player_leave.id);
+	}
+
+	for (size_t i = 0; i + 1 < split->length; ++i)
+		split->segments[i].end = split->segments[i + 1].offset;
+	split->segments[split->length - 1].end = s->offset;
+}
+
+struct hbr *hbr_segment_open(const struct hbr *hbr, const struct hbr_split *split,
+		size_t i, struct hb_arena *arena)
+{
+	const struct hbr_segment *seg = &split->segments[i];
+	struct hbr *part = hb_arena_alloc(arena, sizeof(*part));
+
+	*part = *hbr;
+	part->arena = arena;
+	part->room_name = hb_intern_cstr(split->room_name);
+	part->current_frame = seg->frame;
+	memset(part->event_counts, 0, sizeof(part->event_counts));
+	part->teams_lock = seg->teams_lock;
+	part->red_shirt = seg->red_shirt;
+	part->blue_shirt = seg->blue_shirt;
+	part->player_list.length = seg->player_count;
+	for (size_t j = 0; j < seg->player_count; ++j) {
+		struct hb_player *player = &part->player_list.players[j];
+		*player = split->players[seg->first_player + j];
+		player->name = hb_intern_cstr(split->player_strings[seg->first_player + j][0]);
+		player->country = hb_intern_cstr(split->player_strings[seg->first_player + j][1]);
+		player->avatar = hb_intern_cstr(split->player_strings[seg->first_player + j][2]);
+	}
+
+	part->stream = hb_stream_reader_from_buffer(arena, hbr->stream->data, seg->end);
+	if (seg->stadium) {
+		part->stream->offset = seg->stadium;
+		hbr_read_stadium(part, part->stream);
+	}
+	part->stream->offset = seg->offset;
+	return part;
+}
+
+void hbr_split_free(struct hbr_split *split)
+{
+	free(split->segments);
+	free(split->players);
+	free(split->player_strings);
+	memset(split, 0, sizeof(*split));
+}
+
+bool hbr_seek_frame(struct hbr *hbr, uint32_t frame)
+{
+	if (NULL == hbr->pack) return false;
+	hbr->current_frame = hbr_pack_seek(hbr->pack, frame);
+	return true;
+}
+
+bool hbr_failed(const struct hbr *hbr)
+{
+	return hbr->stream->failed;
 }
 
 void hbr_free(struct hbr *hbr)
 {
-	hb_stream_reader_free(hbr->stream);
-	free(hbr);
+	if (hbr->pack) hbr_pack_free(hbr->pack);
+	else hb_stream_reader_free(hbr->stream);
+	if (NULL == hbr->arena) free(hbr);
 }
@@ -20,21 +20,25 @@
 #include <hb/team.h>
 #include <stdint.h>
 
+#include "arena.h"
+#include "intern.h"
 #include "player.h"
 #include "stream_reader.h"
 #include "events.h"
 
 #define HBR_MAGIC (0x48425250)
-#define HBR_MIN_VERSION (7)
-#define HBR_MAX_VERSION (12)
+
+struct hbr_codec;
+struct hbr_pack;
 
 struct hbr
 {
 	uint32_t version;
+	const struct hbr_codec *codec;
 	uint32_t magic;
 	uint32_t total_frames;
 	uint32_t start_frame;
-	char room_name[128];
+	uint32_t room_name;
 	bool teams_lock;
 	uint8_t score_limit;
 	uint8_t time_limit;
@@ -52,9 +56,112 @@ struct hbr
 	struct hb_player_list player_list;
 	struct hb_shirt red_shirt, blue_shirt;
 	uint32_t current_frame;
+	size_t event_offset;
+	uint32_t event_counts[HB_EVENT_KIND_COUNT];
 	struct hb_stream_reader *stream;
+	struct hbr_pack *pack;
+	struct hb_arena *arena;
+};
+
+// Event as seen by a visitor: strings are views into the inflated replay and
+// players point into the live hbr->player_list, both only valid for the
+// duration of the callback. `player` is the entry of `by_player`, NULL when
+// it is not in the room (the host).
+struct hbr_visit
+{
+	uint32_t by_player;
+	uint8_t type;
+	struct hb_player *player;
+	union {
+		struct hbr_visit_player_join { struct hb_player *player; struct hb_str_view name, country; } player_join;
+		struct hbr_visit_player_leave { uint16_t id; struct hb_player *player; bool kicked, ban; struct hb_str_view reason; } player_leave;
+		struct hbr_visit_player_chat { struct hb_str_view message; } player_chat;
+		struct hbr_visit_set_player_input { uint8_t input; } set_player_input;
+		struct hbr_visit_set_player_team { struct hb_player *player; enum hb_team team; } set_player_team;
+		struct hbr_visit_set_teams_lock { bool teams_lock; } set_teams_lock;
+		struct hbr_visit_set_game_setting { uint8_t setting_id; uint32_t setting_value; } set_game_setting;
+		struct hbr_visit_set_player_avatar { struct hb_str_view avatar; } set_player_avatar;
+		struct hbr_visit_set_player_admin { struct hb_player *player; bool is_admin; } set_player_admin;
+		struct hbr_visit_set_stadium { const char *default_stadium; struct hb_stadium *stadium; } set_stadium;
+		struct hbr_visit_pause_resume_game { bool paused; } pause_resume_game;
+		// Raw pings, in units of 4 ms.
+		struct hbr_visit_ping_update { uint8_t ping_count; const uint8_t *pings; } ping_update;
+		struct hbr_visit_set_player_handicap { uint16_t handicap; } set_player_handicap;
+		struct hbr_visit_set_team_shirt { enum hb_team team; struct hb_shirt *shirt; } set_team_shirt;
+	};
+};
+
+// Room state where a segment of the event stream starts, enough to decode
+// it apart from the rest.
+// Room state at the start of a segment. Scores are not part of it: goals
+// are not events, the decoder only has those of the header, which every
+// segment inherits from the replay like a sequential read would.
+struct hbr_segment
+{
+	size_t offset, end;
+	uint32_t frame;
+	// Events before the segment.
+	uint32_t event_counts[HB_EVENT_KIND_COUNT];
+	bool teams_lock;
+	struct hb_shirt red_shirt, blue_shirt;
+	// Offset of the last SET_STADIUM, decoded when the segment is opened; 0
+	// while the stadium of the header holds.
+	size_t stadium;
+	// Range of the room's players in hbr_split.players.
+	size_t first_player, player_count;
+};
+
+struct hbr_split
+{
+	struct hbr_segment *segments;
+	size_t length, cap;
+	const char *room_name;
+	struct hb_player *players;
+	// Name, country and avatar of each player: the interned ids only mean
+	// something to the thread that split the replay.
+	const char *(*player_strings)[3];
+	size_t players_length, players_cap;
+};
+
+typedef void (*hbr_visit_fn)(struct hbr *hbr, const struct hbr_visit *v, void *data);
+
+struct hbr_visitor
+{
+	hbr_visit_fn on[HB_EVENT_KIND_COUNT];
+	void *data;
 };
 
+// NULL when the file is not a replay of a known version, does not inflate
+// or its header is malformed.
 struct hbr *hbr_parse(const char *path);
+// Every allocation comes from `arena`, hbr_free() then only releases what
+// the arena does not own and the memory is reclaimed by hb_arena_reset().
+struct hbr *hbr_parse_arena(const char *path, struct hb_arena *arena);
+// Same, from the file contents already in memory, packed or not. `data`
+// must outlive the hbr.
+struct hbr *hbr_parse_buffer(uint8_t *data, size_t len, struct hb_arena *arena);
 int hbr_next_event(struct hbr *hbr, struct hb_event *ev);
+// Pushes the remaining events to `visitor`. Kinds without a handler are
+// skipped without decoding, except that the player table is always kept
+// current; the stadium, shirts and teams lock only follow visited events.
+// Returns the number of events read.
+size_t hbr_visit(struct hbr *hbr, const struct hbr_visitor *visitor);
+// Skip-scans the remaining events, decoding only what the room state needs,
+// and cuts the stream before every START_MATCH/STOP_MATCH that is at least
+// `min_len` bytes past the previous cut. The replay is left at its end with
+// every event counted, stadiums are skipped and it keeps the one it had.
+// Unpacked replays only.
+void hbr_split(struct hbr *hbr, size_t min_len, struct hbr_split *split);
+// Replay positioned at the start of segment `i` that ends with it, to be
+// visited on any thread as long as `hbr` is left alone meanwhile. Every
+// allocation comes from `arena`, which must not be NULL.
+struct hbr *hbr_segment_open(const struct hbr *hbr, const struct hbr_split *split,
+		size_t i, struct hb_arena *arena);
+void hbr_split_free(struct hbr_split *split);
+// Packed replays only: resumes decoding at the block holding `frame`, the
+// room state (player list, stadium, ...) is left as it is.
+bool hbr_seek_frame(struct hbr *hbr, uint32_t frame);
+// True once decoding stopped at a truncated or malformed event, the events
+// read so far are all valid.
+bool hbr_failed(const struct hbr *hbr);
 void hbr_free(struct hbr *hbr);
@@ -0,0 +1,279 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "buf.h"
+#include "proto.h"
+
+struct reader
+{
+	const uint8_t *data;
+	size_t len, offset;
+	bool overrun;
+};
+
+struct bench
+{
+	const char *socket_path, *replay_path;
+	uint8_t op;
+	size_t requests;
+	double *latencies;
+	size_t failed;
+};
+
+static const uint8_t *take(struct reader *r, size_t len)
+{
+	if (r->len - r->offset < len) { r->overrun = true; return NULL; }
+	r->offset += len;
+	return &r->data[r->offset - len];
+}
+
+static uint32_t take_uint(struct reader *r, size_t len)
+{
+	const uint8_t *p = take(r, len);
+	uint32_t v = 0;
+	for (size_t i = 0; p && i < len; ++i) v = (v << 8) | p[i];
+	return v;
+}
+
+static void print_string(struct reader *r)
+{
+	uint16_t len = (uint16_t) take_uint(r, 2);
+	const uint8_t *p = take(r, len);
+	if (p) fwrite(p, 1, len, stdout);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int connect_to(const char *socket_path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (fd == -1) return -1;
+	strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static bool request(int fd, uint8_t op, uint32_t mask, const char *path,
+		struct hb_buf *b)
+{
+	hbr_proto_begin(b);
+	hb_buf_put_uint8(b, op);
+	hb_buf_put_uint32(b, mask);
+	hb_buf_put(b, path, strlen(path));
+	return hbr_proto_send(fd, b) && hbr_proto_recv(fd, b) && b->len > 0;
+}
+
+static void print_header(struct reader *r)
+{
+	printf("version: %u\n", take_uint(r, 4));
+	printf("total frames: %u\n", take_uint(r, 4));
+	printf("room: "); print_string(r); printf("\n");
+	printf("stadium: "); print_string(r); printf("\n");
+	for (uint16_t count = (uint16_t) take_uint(r, 2); count > 0 && !r->overrun; --count) {
+		printf("player %u: ", take_uint(r, 4));
+		print_string(r);
+		printf(" (");
+		print_string(r);
+		printf(") team %u\n", take_uint(r, 1));
+	}
+}
+
+static void print_events(struct reader *r)
+{
+	while (r->offset < r->len && !r->overrun) {
+		uint32_t frame = take_uint(r, 4), by_player = take_uint(r, 4);
+		uint8_t type = (uint8_t) take_uint(r, 1);
+		uint32_t len = take_uint(r, 4);
+		struct reader payload = { .data = take(r, len), .len = len };
+
+		printf("%u %u %u", frame, by_player, type);
+		// Chat and stadium payloads start with a string.
+		if (payload.data && (type == 2 || type == 13)) {
+			printf(" ");
+			print_string(&payload);
+		}
+		printf("\n");
+	}
+}
+
+static void print_stadiums(struct reader *r)
+{
+	while (r->offset < r->len && !r->overrun) {
+		uint32_t len = take_uint(r, 4);
+		const uint8_t *p = take(r, len);
+		if (p) fwrite(p, 1, len, stdout);
+	}
+}
+
+static void *bench_run(void *arg)
+{
+	struct bench *b = arg;
+	struct hb_buf buf = {0};
+	int fd = connect_to(b->socket_path);
+
+	for (size_t i = 0; i < b->requests; ++i) {
+		double start = now();
+		if (fd == -1 || !request(fd, b->op, UINT32_MAX, b->replay_path, &buf) ||
+				buf.data[0] != HBR_PROTO_OK) {
+			b->failed += b->requests - i;
+			break;
+		}
+		b->latencies[i] = now() - start;
+	}
+
+	if (fd != -1) close(fd);
+	hb_buf_free(&buf);
+	return NULL;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+static int bench(const char *socket_path, uint8_t op, const char *path,
+		size_t requests, size_t connections)
+{
+	struct bench *benches = calloc(connections, sizeof(*benches));
+	pthread_t *threads = calloc(connections, sizeof(*threads));
+	double *latencies = calloc(requests * connections, sizeof(*latencies));
+	size_t done = 0, failed = 0;
+
+	if (!benches || !threads || !latencies) { perror("calloc"); return 1; }
+
+	double start = now();
+
+	for (size_t i = 0; i < connections; ++i) {
+		benches[i] = (struct bench) {
+			.socket_path = socket_path, .replay_path = path, .op = op,
+			.requests = requests, .latencies = &latencies[i * requests]
+		};
+		pthread_create(&threads[i], NULL, bench_run, &benches[i]);
+	}
+
+	for (size_t i = 0; i < connections; ++i) {
+		pthread_join(threads[i], NULL);
+		failed += benches[i].failed;
+		for (size_t j = 0; j < requests - benches[i].failed; ++j)
+			latencies[done++] = benches[i].latencies[j];
+	}
+
+	double elapsed = now() - start;
+
+	qsort(latencies, done, sizeof(*latencies), compare_double);
+
+	printf("%zu requests, %zu failed, %.1f req/s\n", done, failed, done / elapsed);
+	if (done > 0) {
+		printf("p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+				latencies[done / 2] * 1e3,
+				latencies[(done * 99) / 100] * 1e3,
+				latencies[done - 1] * 1e3);
+	}
+
+	free(benches);
+	free(threads);
+	free(latencies);
+	return failed > 0;
+}
+
+static bool parse_op(const char *name, uint8_t *op)
+{
+	if (!strcmp(name, "header")) *op = HBR_PROTO_HEADER;
+	else if (!strcmp(name, "events")) *op = HBR_PROTO_EVENTS;
+	else if (!strcmp(name, "stadiums")) *op = HBR_PROTO_STADIUMS;
+	else return false;
+	return true;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct hb_buf buf = {0};
+	char path[PATH_MAX];
+	uint32_t mask = 0;
+	uint8_t op;
+	int fd;
+
+	if (argc <= 3) {
+		printf("usage: hbrclient SOCKET header|stadiums PATH\n"
+		       "       hbrclient SOCKET events PATH [TYPE...]\n"
+		       "       hbrclient SOCKET bench header|events|stadiums PATH REQUESTS CONNECTIONS\n");
+		return 1;
+	}
+
+	bool benching = !strcmp(argv[2], "bench");
+	if (benching && (argc <= 6 || !parse_op(argv[3], &op))) return 1;
+
+	// The server does not share our working directory.
+	const char *replay_path = argv[benching ? 4 : 3];
+	if (NULL == realpath(replay_path, path)) {
+		perror(replay_path);
+		return 1;
+	}
+
+	if (benching)
+		return bench(argv[1], op, path, strtoul(argv[5], NULL, 10),
+				strtoul(argv[6], NULL, 10));
+
+	if (!parse_op(argv[2], &op)) { printf("Invalid operation!\n"); return 1; }
+
+	for (int i = 4; i < argc; ++i)
+		mask |= 1u << (atoi(argv[i]) & 31);
+
+	if ((fd = connect_to(argv[1])) == -1) { perror("connect"); return 1; }
+
+	if (!request(fd, op, mask ? mask : UINT32_MAX, path, &buf)) {
+		printf("Connection closed!\n");
+		return 1;
+	}
+
+	struct reader r = { .data = &buf.data[1], .len = buf.len - 1 };
+
+	if (buf.data[0] != HBR_PROTO_OK) {
+		printf("Error: %.*s\n", (int) r.len, (const char *) r.data);
+		return 1;
+	}
+
+	switch (op) {
+	case HBR_PROTO_HEADER: print_header(&r); break;
+	case HBR_PROTO_EVENTS: print_events(&r); break;
+	case HBR_PROTO_STADIUMS: print_stadiums(&r); break;
+	}
+
+	close(fd);
+	hb_buf_free(&buf);
+	return 0;
+}
@@ -0,0 +1,109 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "arena.h"
+#include "inflate.h"
+
+#define HB_INFLATE_MIN_CAPACITY (64*1024)
+
+static const struct hb_inflate_backend *backends[] = {
+	&hb_inflate_backend_fast,
+	&hb_inflate_backend_zlib
+};
+
+static const struct hb_inflate_backend *current_backend = &hb_inflate_backend_fast;
+
+const struct hb_inflate_backend *hb_inflate_backend_find(const char *name)
+{
+	for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); ++i)
+		if (!strcmp(backends[i]->name, name))
+			return backends[i];
+	return NULL;
+}
+
+const struct hb_inflate_backend *hb_inflate_backend_get(void)
+{
+	return current_backend;
+}
+
+void hb_inflate_backend_set(const struct hb_inflate_backend *backend)
+{
+	current_backend = backend;
+}
+
+bool hb_inflate_buf_reserve(struct hb_inflate_buf *buf, size_t extra)
+{
+	if (buf->cap - buf->len >= extra) return true;
+	if (buf->max - buf->len < extra) return false;
+
+	size_t cap = buf->cap < HB_INFLATE_MIN_CAPACITY ?
+		HB_INFLATE_MIN_CAPACITY : buf->cap;
+	while (cap - buf->len < extra) cap *= 2;
+	if (cap > buf->max) cap = buf->max;
+
+	uint8_t *data = buf->arena ? hb_arena_realloc(buf->arena, buf->data, buf->len, cap) :
+		realloc(buf->data, cap);
+	if (NULL == data) return false;
+	buf->data = data;
+	buf->cap = cap;
+	return true;
+}
+
+int hb_inflate(const uint8_t *in, size_t len, bool raw,
+		struct hb_inflate_buf *out)
+{
+	// Replays compress roughly 8:1, start there instead of at the minimum
+	// so the common case only allocates once.
+	if (NULL == out->data && !hb_inflate_buf_reserve(out, len * 8))
+		hb_inflate_buf_reserve(out, 1);
+	return current_backend->inflate(in, len, raw, out);
+}
+
+static int hb_inflate_zlib(const uint8_t *in, size_t len, bool raw,
+		struct hb_inflate_buf *out)
+{
+	int ret;
+	z_stream strm = { .zalloc = Z_NULL, .zfree = Z_NULL, .opaque = Z_NULL };
+
+	if ((raw ? inflateInit2(&strm, -15) : inflateInit(&strm)) != Z_OK)
+		return HB_INFLATE_ERROR;
+
+	strm.next_in = (Bytef *) in;
+	strm.avail_in = len;
+
+	do {
+		if (out->len == out->cap && !hb_inflate_buf_reserve(out, 1)) {
+			inflateEnd(&strm);
+			return HB_INFLATE_OVERFLOW;
+		}
+		strm.next_out = &out->data[out->len];
+		strm.avail_out = out->cap - out->len;
+		ret = inflate(&strm, Z_FINISH);
+		out->len = out->cap - strm.avail_out;
+	} while (ret == Z_OK || (ret == Z_BUF_ERROR && strm.avail_out == 0));
+
+	inflateEnd(&strm);
+	return ret == Z_STREAM_END ? HB_INFLATE_OK : HB_INFLATE_ERROR;
+}
+
+const struct hb_inflate_backend hb_inflate_backend_zlib = {
+	.name = "zlib",
+	.inflate = hb_inflate_zlib
+};
@@ -0,0 +1,57 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "arena.h"
+
+enum hb_inflate_status
+{
+	HB_INFLATE_OK       =  0,
+	HB_INFLATE_ERROR    = -1,
+	HB_INFLATE_OVERFLOW = -2
+};
+
+// Output buffer of an inflate call. The buffer grows (realloc, or from
+// `arena` when set) up to `max` bytes; a caller that knows the inflated size
+// up front passes a buffer with cap == max, which is filled in place without
+// ever reallocating.
+struct hb_inflate_buf
+{
+	uint8_t *data;
+	size_t len, cap, max;
+	struct hb_arena *arena;
+};
+
+struct hb_inflate_backend
+{
+	const char *name;
+	int (*inflate)(const uint8_t *in, size_t len, bool raw,
+			struct hb_inflate_buf *out);
+};
+
+extern const struct hb_inflate_backend hb_inflate_backend_zlib;
+extern const struct hb_inflate_backend hb_inflate_backend_fast;
+
+const struct hb_inflate_backend *hb_inflate_backend_find(const char *name);
+const struct hb_inflate_backend *hb_inflate_backend_get(void);
+void hb_inflate_backend_set(const struct hb_inflate_backend *backend);
+
+bool hb_inflate_buf_reserve(struct hb_inflate_buf *buf, size_t extra);
+int hb_inflate(const uint8_t *in, size_t len, bool raw,
+		struct hb_inflate_buf *out);
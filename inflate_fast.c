@@ -0,0 +1,399 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+// Table driven inflate (RFC 1950/1951). Bits are pulled from the input a
+// 64 bit word at a time and codes up to HB_HUFF_FAST_BITS long resolve with
+// a single table lookup, longer ones fall back to a canonical code search.
+
+#include <endian.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <zlib.h>
+#include "inflate.h"
+
+#define HB_HUFF_FAST_BITS (10)
+#define HB_HUFF_MAX_SYMBOLS (288)
+
+struct hb_huff
+{
+	uint16_t fast[1 << HB_HUFF_FAST_BITS];
+	uint16_t first_code[16], first_symbol[16];
+	uint32_t max_code[17];
+	uint8_t size[HB_HUFF_MAX_SYMBOLS];
+	uint16_t value[HB_HUFF_MAX_SYMBOLS];
+};
+
+struct hb_inflate_state
+{
+	const uint8_t *in, *in_end;
+	uint64_t bits;
+	unsigned nbits, pad;
+	struct hb_inflate_buf *out;
+	struct hb_huff lit, dist;
+};
+
+static const uint16_t length_base[] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const uint8_t length_extra[] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const uint16_t dist_base[] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+	8193, 12289, 16385, 24577
+};
+
+static const uint8_t dist_extra[] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static const uint8_t code_length_order[] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+static inline void hb_inflate_refill(struct hb_inflate_state *st)
+{
+	if (st->in_end - st->in >= 8) {
+		uint64_t word;
+		memcpy(&word, st->in, sizeof(word));
+		st->bits |= le64toh(word) << st->nbits;
+		st->in += (63 - st->nbits) >> 3;
+		st->nbits |= 56;
+		return;
+	}
+
+	while (st->nbits <= 56) {
+		if (st->in < st->in_end) st->bits |= (uint64_t)(*st->in++) << st->nbits;
+		else st->pad += 1;
+		st->nbits += 8;
+	}
+}
+
+static inline uint32_t hb_inflate_bits(struct hb_inflate_state *st, unsigned n)
+{
+	uint32_t v = (uint32_t)(st->bits & ((1ull << n) - 1));
+	st->bits >>= n;
+	st->nbits -= n;
+	return v;
+}
+
+static inline unsigned hb_inflate_bit_reverse(unsigned v, unsigned bits)
+{
+	v = ((v & 0xAAAA) >> 1) | ((v & 0x5555) << 1);
+	v = ((v & 0xCCCC) >> 2) | ((v & 0x3333) << 2);
+	v = ((v & 0xF0F0) >> 4) | ((v & 0x0F0F) << 4);
+	v = ((v & 0xFF00) >> 8) | ((v & 0x00FF) << 8);
+	return v >> (16 - bits);
+}
+
+static bool hb_huff_build(struct hb_huff *h, const uint8_t *lengths, size_t count)
+{
+	unsigned sizes[17] = {0}, next_code[16];
+	unsigned code = 0, k = 0;
+
+	memset(h->fast, 0, sizeof(h->fast));
+
+	for (size_t i = 0; i < count; ++i) ++sizes[lengths[i]];
+	sizes[0] = 0;
+
+	for (unsigned i = 1; i < 16; ++i) {
+		if (sizes[i] > (1u << i)) return false;
+		next_code[i] = code;
+		h->first_code[i] = (uint16_t) code;
+		h->first_symbol[i] = (uint16_t) k;
+		code += sizes[i];
+		if (sizes[i] && code - 1 >= (1u << i)) return false;
+		h->max_code[i] = code << (16 - i);
+		code <<= 1;
+		k += sizes[i];
+	}
+
+	h->max_code[16] = 0x10000;
+
+	for (size_t i = 0; i < count; ++i) {
+		unsigned s = lengths[i];
+		if (0 == s) continue;
+		unsigned c = next_code[s] - h->first_code[s] + h->first_symbol[s];
+		h->size[c] = (uint8_t) s;
+		h->value[c] = (uint16_t) i;
+		if (s <= HB_HUFF_FAST_BITS) {
+			uint16_t entry = (uint16_t)((s << 9) | i);
+			for (unsigned j = hb_inflate_bit_reverse(next_code[s], s);
+					j < (1u << HB_HUFF_FAST_BITS); j += (1u << s))
+				h->fast[j] = entry;
+		}
+		++next_code[s];
+	}
+
+	return true;
+}
+
+// Expects at least 15 bits in the buffer, returns -1 on an invalid code.
+static inline int hb_huff_decode(struct hb_inflate_state *st, const struct hb_huff *h)
+{
+	uint16_t entry = h->fast[st->bits & ((1u << HB_HUFF_FAST_BITS) - 1)];
+
+	if (entry) {
+		st->bits >>= entry >> 9;
+		st->nbits -= entry >> 9;
+		return entry & 511;
+	}
+
+	unsigned k = hb_inflate_bit_reverse((unsigned)(st->bits & 0xFFFF), 16);
+	unsigned s;
+
+	for (s = HB_HUFF_FAST_BITS + 1; k >= h->max_code[s]; ++s)
+		;
+
+	if (s >= 16) return -1;
+
+	unsigned c = (k >> (16 - s)) - h->first_code[s] + h->first_symbol[s];
+	if (c >= HB_HUFF_MAX_SYMBOLS || h->size[c] != s) return -1;
+
+	st->bits >>= s;
+	st->nbits -= s;
+	return h->value[c];
+}
+
+static inline void hb_inflate_copy_match(uint8_t *dst, size_t dist, size_t len,
+		bool can_overshoot)
+{
+	const uint8_t *src = dst - dist;
+
+	if (can_overshoot && dist >= 8) {
+		uint8_t *end = dst + len;
+		do {
+			memcpy(dst, src, 8);
+			dst += 8;
+			src += 8;
+		} while (dst < end);
+		return;
+	}
+
+	while (len-- > 0)
+		*dst++ = *src++;
+}
+
+static int hb_inflate_codes(struct hb_inflate_state *st)
+{
+	struct hb_inflate_buf *out = st->out;
+
+	for (;;) {
+		hb_inflate_refill(st);
+		if (st->pad > 8) return HB_INFLATE_ERROR;
+
+		int sym = hb_huff_decode(st, &st->lit);
+
+		if (sym < 256) {
+			if (sym < 0) return HB_INFLATE_ERROR;
+			if (out->len == out->cap && !hb_inflate_buf_reserve(out, 1))
+				return HB_INFLATE_OVERFLOW;
+			out->data[out->len++] = (uint8_t) sym;
+			continue;
+		}
+
+		if (sym == 256) return HB_INFLATE_OK;
+
+		sym -= 257;
+		if (sym >= 29) return HB_INFLATE_ERROR;
+
+		size_t len = length_base[sym] + hb_inflate_bits(st, length_extra[sym]);
+		int dsym = hb_huff_decode(st, &st->dist);
+		if (dsym < 0 || dsym >= 30) return HB_INFLATE_ERROR;
+
+		size_t dist = dist_base[dsym] + hb_inflate_bits(st, dist_extra[dsym]);
+		if (dist > out->len) return HB_INFLATE_ERROR;
+
+		if (!hb_inflate_buf_reserve(out, len))
+			return HB_INFLATE_OVERFLOW;
+
+		hb_inflate_copy_match(&out->data[out->len], dist, len,
+				out->cap - out->len >= len + 8);
+		out->len += len;
+	}
+}
+
+static int hb_inflate_stored(struct hb_inflate_state *st)
+{
+	struct hb_inflate_buf *out = st->out;
+	unsigned back;
+
+	// Realign the input pointer with the bits not consumed yet.
+	hb_inflate_bits(st, st->nbits & 7);
+	back = st->nbits >> 3;
+	if (back < st->pad) return HB_INFLATE_ERROR;
+	st->in -= back - st->pad;
+	st->bits = 0;
+	st->nbits = 0;
+	st->pad = 0;
+
+	if (st->in_end - st->in < 4) return HB_INFLATE_ERROR;
+	unsigned len = st->in[0] | (st->in[1] << 8);
+	unsigned nlen = st->in[2] | (st->in[3] << 8);
+	st->in += 4;
+
+	if ((nlen ^ 0xFFFF) != len) return HB_INFLATE_ERROR;
+	if (st->in_end - st->in < len) return HB_INFLATE_ERROR;
+	if (!hb_inflate_buf_reserve(out, len)) return HB_INFLATE_OVERFLOW;
+
+	memcpy(&out->data[out->len], st->in, len);
+	out->len += len;
+	st->in += len;
+	return HB_INFLATE_OK;
+}
+
+static int hb_inflate_fixed_tables(struct hb_inflate_state *st)
+{
+	uint8_t lengths[HB_HUFF_MAX_SYMBOLS];
+
+	memset(&lengths[0], 8, 144);
+	memset(&lengths[144], 9, 112);
+	memset(&lengths[256], 7, 24);
+	memset(&lengths[280], 8, 8);
+	if (!hb_huff_build(&st->lit, lengths, 288)) return HB_INFLATE_ERROR;
+
+	memset(&lengths[0], 5, 30);
+	if (!hb_huff_build(&st->dist, lengths, 30)) return HB_INFLATE_ERROR;
+
+	return HB_INFLATE_OK;
+}
+
+static int hb_inflate_dynamic_tables(struct hb_inflate_state *st)
+{
+	uint8_t code_lengths[19] = {0};
+	uint8_t lengths[HB_HUFF_MAX_SYMBOLS + 32];
+	struct hb_huff *codes = &st->dist;
+
+	hb_inflate_refill(st);
+	unsigned hlit = hb_inflate_bits(st, 5) + 257;
+	unsigned hdist = hb_inflate_bits(st, 5) + 1;
+	unsigned hclen = hb_inflate_bits(st, 4) + 4;
+
+	for (unsigned i = 0; i < hclen; ++i) {
+		hb_inflate_refill(st);
+		code_lengths[code_length_order[i]] = (uint8_t) hb_inflate_bits(st, 3);
+	}
+
+	// The distance table is only built after the code lengths are read, so
+	// borrow it for the code length alphabet.
+	if (!hb_huff_build(codes, code_lengths, 19)) return HB_INFLATE_ERROR;
+
+	for (unsigned n = 0; n < hlit + hdist; ) {
+		hb_inflate_refill(st);
+		if (st->pad > 8) return HB_INFLATE_ERROR;
+
+		int sym = hb_huff_decode(st, codes);
+		unsigned repeat;
+		uint8_t fill;
+
+		if (sym < 0) return HB_INFLATE_ERROR;
+		if (sym < 16) { lengths[n++] = (uint8_t) sym; continue; }
+
+		if (sym == 16) {
+			if (n == 0) return HB_INFLATE_ERROR;
+			fill = lengths[n - 1];
+			repeat = 3 + hb_inflate_bits(st, 2);
+		} else if (sym == 17) {
+			fill = 0;
+			repeat = 3 + hb_inflate_bits(st, 3);
+		} else {
+			fill = 0;
+			repeat = 11 + hb_inflate_bits(st, 7);
+		}
+
+		if (n + repeat > hlit + hdist) return HB_INFLATE_ERROR;
+		memset(&lengths[n], fill, repeat);
+		n += repeat;
+	}
+
+	if (lengths[256] == 0) return HB_INFLATE_ERROR;
+	if (!hb_huff_build(&st->lit, lengths, hlit)) return HB_INFLATE_ERROR;
+	if (!hb_huff_build(&st->dist, &lengths[hlit], hdist)) return HB_INFLATE_ERROR;
+
+	return HB_INFLATE_OK;
+}
+
+static int hb_inflate_fast(const uint8_t *in, size_t len, bool raw,
+		struct hb_inflate_buf *out)
+{
+	struct hb_inflate_state st = {
+		.in = in, .in_end = in + len,
+		.bits = 0, .nbits = 0, .pad = 0,
+		.out = out
+	};
+	size_t start = out->len;
+	bool final;
+	int ret;
+
+	if (!raw) {
+		if (len < 6) return HB_INFLATE_ERROR;
+		if ((in[0] & 0x0F) != 8 || (in[1] & 0x20)) return HB_INFLATE_ERROR;
+		if (((in[0] << 8) | in[1]) % 31 != 0) return HB_INFLATE_ERROR;
+		st.in += 2;
+	}
+
+	do {
+		hb_inflate_refill(&st);
+		final = hb_inflate_bits(&st, 1);
+
+		switch (hb_inflate_bits(&st, 2)) {
+		case 0:
+			ret = hb_inflate_stored(&st);
+			break;
+		case 1:
+			ret = hb_inflate_fixed_tables(&st);
+			if (ret == HB_INFLATE_OK) ret = hb_inflate_codes(&st);
+			break;
+		case 2:
+			ret = hb_inflate_dynamic_tables(&st);
+			if (ret == HB_INFLATE_OK) ret = hb_inflate_codes(&st);
+			break;
+		default:
+			ret = HB_INFLATE_ERROR;
+			break;
+		}
+
+		if (ret != HB_INFLATE_OK) return ret;
+		if ((st.nbits >> 3) < st.pad) return HB_INFLATE_ERROR;
+	} while (!final);
+
+	if (raw) return HB_INFLATE_OK;
+
+	// Trailing adler32 sits on the next byte boundary.
+	hb_inflate_bits(&st, st.nbits & 7);
+	st.in -= (st.nbits >> 3) - st.pad;
+
+	if (st.in_end - st.in < 4) return HB_INFLATE_ERROR;
+
+	uint32_t expected = ((uint32_t) st.in[0] << 24) | ((uint32_t) st.in[1] << 16) |
+		((uint32_t) st.in[2] << 8) | (uint32_t) st.in[3];
+
+	if (adler32(1, &out->data[start], out->len - start) != expected)
+		return HB_INFLATE_ERROR;
+
+	return HB_INFLATE_OK;
+}
+
+const struct hb_inflate_backend hb_inflate_backend_fast = {
+	.name = "fast",
+	.inflate = hb_inflate_fast
+};
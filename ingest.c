@@ -0,0 +1,444 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "ingest.h"
+
+// Completed files waiting for a worker, readers block once it is full.
+struct hb_ingest_queue
+{
+	const struct hb_ingest *ingest;
+	const char *const *paths;
+	size_t count, next;
+	struct hb_ingest_file **files;
+	size_t head, length, cap;
+	size_t used;
+	bool closed;
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty, not_full, released;
+};
+
+struct hb_ingest_worker
+{
+	struct hb_ingest_queue *queue;
+	size_t id;
+	pthread_t thread;
+};
+
+// One read in flight on the ring, `user_data` is its index.
+struct hb_ingest_slot
+{
+	struct hb_ingest_file *file;
+	int fd;
+	size_t done;
+	struct iovec iov;
+};
+
+// Just the parts of liburing needed here, on top of the raw syscalls.
+struct hb_uring
+{
+	int fd;
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_len, cq_ring_len, sqes_len;
+};
+
+static void hb_ingest_push(struct hb_ingest_queue *q, struct hb_ingest_file *file)
+{
+	pthread_mutex_lock(&q->lock);
+	while (q->length == q->cap)
+		pthread_cond_wait(&q->not_full, &q->lock);
+	q->files[(q->head + q->length++) % q->cap] = file;
+	pthread_cond_signal(&q->not_empty);
+	pthread_mutex_unlock(&q->lock);
+}
+
+static struct hb_ingest_file *hb_ingest_pop(struct hb_ingest_queue *q)
+{
+	struct hb_ingest_file *file = NULL;
+
+	pthread_mutex_lock(&q->lock);
+	while (q->length == 0 && !q->closed)
+		pthread_cond_wait(&q->not_empty, &q->lock);
+	if (q->length > 0) {
+		file = q->files[q->head];
+		q->head = (q->head + 1) % q->cap;
+		q->length -= 1;
+		pthread_cond_signal(&q->not_full);
+	}
+	pthread_mutex_unlock(&q->lock);
+	return file;
+}
+
+static void hb_ingest_close(struct hb_ingest_queue *q)
+{
+	pthread_mutex_lock(&q->lock);
+	q->closed = true;
+	pthread_cond_broadcast(&q->not_empty);
+	pthread_mutex_unlock(&q->lock);
+}
+
+// A file larger than the whole budget still goes through, alone.
+static bool hb_ingest_reserve(struct hb_ingest_queue *q, size_t len, bool wait)
+{
+	bool reserved = true;
+
+	pthread_mutex_lock(&q->lock);
+	while (q->used > 0 && q->used + len > q->ingest->budget) {
+		if (!wait) { reserved = false; break; }
+		pthread_cond_wait(&q->released, &q->lock);
+	}
+	if (reserved) q->used += len;
+	pthread_mutex_unlock(&q->lock);
+	return reserved;
+}
+
+static void hb_ingest_release(struct hb_ingest_queue *q, size_t len)
+{
+	pthread_mutex_lock(&q->lock);
+	q->used -= len;
+	pthread_cond_broadcast(&q->released);
+	pthread_mutex_unlock(&q->lock);
+}
+
+static struct hb_ingest_file *hb_ingest_open(struct hb_ingest_queue *q, size_t index, int *fd)
+{
+	struct hb_ingest_file *file = calloc(1, sizeof(*file));
+	struct stat st;
+
+	assert(file != NULL);
+	file->path = q->paths[index];
+	file->index = index;
+
+	if ((*fd = open(file->path, O_RDONLY | O_CLOEXEC)) == -1 || fstat(*fd, &st) == -1) {
+		file->error = errno;
+		if (*fd != -1) close(*fd);
+		*fd = -1;
+		return file;
+	}
+
+	file->len = (size_t) st.st_size;
+	return file;
+}
+
+// Called with the budget for `file->len` reserved.
+static void hb_ingest_alloc(struct hb_ingest_file *file)
+{
+	file->data = malloc(file->len ? file->len : 1);
+	assert(file->data != NULL);
+}
+
+static void hb_ingest_fail(struct hb_ingest_queue *q, struct hb_ingest_file *file, int error)
+{
+	hb_ingest_release(q, file->len);
+	free(file->data);
+	file->data = NULL;
+	file->len = 0;
+	file->error = error;
+}
+
+static void *hb_ingest_work(void *arg)
+{
+	struct hb_ingest_worker *w = arg;
+	struct hb_ingest_queue *q = w->queue;
+	struct hb_ingest_file *file;
+
+	while ((file = hb_ingest_pop(q)) != NULL) {
+		q->ingest->fn(file, w->id, q->ingest->data);
+		hb_ingest_release(q, file->len);
+		free(file->data);
+		free(file);
+	}
+
+	if (q->ingest->done) q->ingest->done(w->id, q->ingest->data);
+	return NULL;
+}
+
+static void *hb_ingest_read(void *arg)
+{
+	struct hb_ingest_queue *q = arg;
+
+	for (;;) {
+		pthread_mutex_lock(&q->lock);
+		size_t index = q->next < q->count ? q->next++ : q->count;
+		pthread_mutex_unlock(&q->lock);
+		if (index == q->count) break;
+
+		int fd;
+		struct hb_ingest_file *file = hb_ingest_open(q, index, &fd);
+
+		if (fd != -1) {
+			size_t done = 0;
+
+			hb_ingest_reserve(q, file->len, true);
+			hb_ingest_alloc(file);
+			while (done < file->len) {
+				ssize_t n = pread(fd, &file->data[done], file->len - done, (off_t) done);
+				if (n == -1 && errno == EINTR) continue;
+				if (n <= 0) { hb_ingest_fail(q, file, n == 0 ? EIO : errno); break; }
+				done += (size_t) n;
+			}
+			close(fd);
+		}
+
+		hb_ingest_push(q, file);
+	}
+
+	return NULL;
+}
+
+static void hb_uring_free(struct hb_uring *r)
+{
+	if (r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_len);
+	if (r->cq_ring != MAP_FAILED && r->cq_ring != r->sq_ring) munmap(r->cq_ring, r->cq_ring_len);
+	if (r->sq_ring != MAP_FAILED) munmap(r->sq_ring, r->sq_ring_len);
+	close(r->fd);
+}
+
+// Fails where the kernel lacks io_uring or a seccomp policy forbids it.
+static bool hb_uring_init(struct hb_uring *r, unsigned entries)
+{
+	struct io_uring_params p;
+
+	memset(&p, 0, sizeof(p));
+	if ((r->fd = (int) syscall(__NR_io_uring_setup, entries, &p)) == -1)
+		return false;
+
+	r->sq_ring_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_ring_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (r->cq_ring_len > r->sq_ring_len) r->sq_ring_len = r->cq_ring_len;
+		r->cq_ring_len = r->sq_ring_len;
+	}
+
+	r->sq_ring = mmap(NULL, r->sq_ring_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	r->cq_ring = (p.features & IORING_FEAT_SINGLE_MMAP) ? r->sq_ring :
+		mmap(NULL, r->cq_ring_len, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+	r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+
+	if (r->sq_ring == MAP_FAILED || r->cq_ring == MAP_FAILED || r->sqes == MAP_FAILED) {
+		hb_uring_free(r);
+		return false;
+	}
+
+	uint8_t *sq = r->sq_ring, *cq = r->cq_ring;
+	r->sq_tail = (unsigned *) &sq[p.sq_off.tail];
+	r->sq_mask = (unsigned *) &sq[p.sq_off.ring_mask];
+	r->sq_array = (unsigned *) &sq[p.sq_off.array];
+	r->cq_head = (unsigned *) &cq[p.cq_off.head];
+	r->cq_tail = (unsigned *) &cq[p.cq_off.tail];
+	r->cq_mask = (unsigned *) &cq[p.cq_off.ring_mask];
+	r->cqes = (struct io_uring_cqe *) &cq[p.cq_off.cqes];
+	return true;
+}
+
+// READV rather than READ, it is there since the first io_uring kernels.
+static void hb_uring_readv(struct hb_uring *r, int fd, struct iovec *iov,
+		size_t offset, uint64_t user_data)
+{
+	unsigned tail = *r->sq_tail, index = tail & *r->sq_mask;
+	struct io_uring_sqe *sqe = &r->sqes[index];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_READV;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t) iov;
+	sqe->len = 1;
+	sqe->off = offset;
+	sqe->user_data = user_data;
+	r->sq_array[index] = index;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static void hb_uring_enter(struct hb_uring *r, unsigned submit, unsigned wait)
+{
+	while (submit > 0 || wait > 0) {
+		long n = syscall(__NR_io_uring_enter, r->fd, submit, wait, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (n == -1) {
+			assert(errno == EINTR || errno == EAGAIN || errno == EBUSY);
+			continue;
+		}
+		submit -= (unsigned) n;
+		wait = 0;
+	}
+}
+
+static bool hb_uring_reap(struct hb_uring *r, struct io_uring_cqe *cqe)
+{
+	unsigned head = *r->cq_head;
+
+	if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) return false;
+	*cqe = r->cqes[head & *r->cq_mask];
+	__atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+static void hb_ingest_slot_read(struct hb_uring *r, struct hb_ingest_slot *slots, size_t i)
+{
+	struct hb_ingest_slot *slot = &slots[i];
+	slot->iov.iov_base = &slot->file->data[slot->done];
+	slot->iov.iov_len = slot->file->len - slot->done;
+	hb_uring_readv(r, slot->fd, &slot->iov, slot->done, i);
+}
+
+// Every slot has at most one request on the ring, so with as many ring
+// entries as slots the submission queue never overflows.
+static void hb_ingest_uring(struct hb_ingest_queue *q, struct hb_uring *r, size_t depth)
+{
+	struct hb_ingest_slot *slots = calloc(depth, sizeof(*slots));
+	size_t *idle = malloc(depth * sizeof(*idle)), idle_count = depth, inflight = 0;
+	struct hb_ingest_file *file = NULL;
+	unsigned submit = 0;
+	int fd = -1;
+
+	assert(slots != NULL && idle != NULL);
+	for (size_t i = 0; i < depth; ++i) idle[i] = depth - 1 - i;
+
+	while (q->next < q->count || inflight > 0) {
+		while (inflight < depth && q->next < q->count) {
+			if (NULL == file) file = hb_ingest_open(q, q->next, &fd);
+
+			if (fd != -1) {
+				// Only block on the budget when nothing of ours is left to
+				// complete, the workers release it then.
+				if (!hb_ingest_reserve(q, file->len, inflight == 0)) break;
+				hb_ingest_alloc(file);
+			}
+
+			q->next += 1;
+			if (fd == -1 || file->len == 0) {
+				if (fd != -1) close(fd);
+				hb_ingest_push(q, file);
+				file = NULL;
+				continue;
+			}
+
+			size_t i = idle[--idle_count];
+			slots[i].file = file;
+			slots[i].fd = fd;
+			slots[i].done = 0;
+			hb_ingest_slot_read(r, slots, i);
+			submit += 1;
+			inflight += 1;
+			file = NULL;
+		}
+
+		if (inflight == 0) continue;
+		hb_uring_enter(r, submit, 1);
+		submit = 0;
+
+		struct io_uring_cqe cqe;
+		while (hb_uring_reap(r, &cqe)) {
+			size_t i = (size_t) cqe.user_data;
+			struct hb_ingest_slot *slot = &slots[i];
+
+			if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+				hb_ingest_slot_read(r, slots, i);
+				submit += 1;
+				continue;
+			}
+
+			if (cqe.res <= 0) {
+				hb_ingest_fail(q, slot->file, cqe.res == 0 ? EIO : -cqe.res);
+			} else if ((slot->done += (size_t) cqe.res) < slot->file->len) {
+				hb_ingest_slot_read(r, slots, i);
+				submit += 1;
+				continue;
+			}
+
+			close(slot->fd);
+			hb_ingest_push(q, slot->file);
+			idle[idle_count++] = i;
+			inflight -= 1;
+		}
+	}
+
+	free(slots);
+	free(idle);
+}
+
+static void hb_ingest_spawn(pthread_t *thread, void *(*fn)(void *), void *arg)
+{
+	if (pthread_create(thread, NULL, fn, arg) != 0) {
+		perror("pthread_create");
+		exit(1);
+	}
+}
+
+void hb_ingest_run(const struct hb_ingest *ingest, const char *const *paths, size_t count)
+{
+	struct hb_ingest_queue q = {
+		.ingest = ingest, .paths = paths, .count = count,
+		.cap = ingest->depth,
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.not_empty = PTHREAD_COND_INITIALIZER,
+		.not_full = PTHREAD_COND_INITIALIZER,
+		.released = PTHREAD_COND_INITIALIZER
+	};
+	struct hb_ingest_worker *workers = calloc(ingest->workers, sizeof(*workers));
+	size_t depth = ingest->depth < count ? ingest->depth : count;
+	struct hb_uring ring;
+
+	assert(ingest->workers > 0 && ingest->depth > 0);
+	q.files = malloc(q.cap * sizeof(*q.files));
+	assert(workers != NULL && q.files != NULL);
+
+	for (size_t i = 0; i < ingest->workers; ++i) {
+		workers[i].queue = &q;
+		workers[i].id = i;
+		hb_ingest_spawn(&workers[i].thread, hb_ingest_work, &workers[i]);
+	}
+
+	if (depth > 0 && !ingest->no_uring && hb_uring_init(&ring, (unsigned) depth)) {
+		hb_ingest_uring(&q, &ring, depth);
+		hb_uring_free(&ring);
+	} else if (depth > 0) {
+		pthread_t *readers = malloc(depth * sizeof(*readers));
+		assert(readers != NULL);
+		for (size_t i = 0; i < depth; ++i)
+			hb_ingest_spawn(&readers[i], hb_ingest_read, &q);
+		for (size_t i = 0; i < depth; ++i)
+			pthread_join(readers[i], NULL);
+		free(readers);
+	}
+
+	hb_ingest_close(&q);
+	for (size_t i = 0; i < ingest->workers; ++i)
+		pthread_join(workers[i].thread, NULL);
+
+	free(workers);
+	free(q.files);
+}
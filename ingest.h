@@ -0,0 +1,56 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// File reads kept in flight by default, as io_uring submissions or as
+// reader threads when io_uring is not available.
+#define HB_INGEST_DEPTH (32)
+// Default cap on file contents held in memory at once, whether they are
+// still being read, waiting for a worker or being decoded.
+#define HB_INGEST_BUDGET (256*1024*1024)
+
+struct hb_ingest_file
+{
+	const char *path;
+	size_t index;
+	uint8_t *data;
+	size_t len;
+	// errno of the failed open or read, `data` is NULL then.
+	int error;
+};
+
+// Runs on decode worker `worker`, the file contents are released (and
+// count against the budget again) once it returns.
+typedef void (*hb_ingest_fn)(struct hb_ingest_file *file, size_t worker, void *data);
+
+struct hb_ingest
+{
+	size_t workers, depth, budget;
+	// Read with the thread pool even where io_uring works.
+	bool no_uring;
+	hb_ingest_fn fn;
+	// Optional, runs on each worker once every file is done.
+	void (*done)(size_t worker, void *data);
+	void *data;
+};
+
+// Reads every path and hands the contents to the workers in completion
+// order, not in the order given. Returns once all of them are processed.
+void hb_ingest_run(const struct hb_ingest *ingest, const char *const *paths, size_t count);
@@ -0,0 +1,155 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "sketch.h"
+#include "stream_reader.h"
+#include "intern.h"
+
+struct hb_intern_entry
+{
+	const char *str;
+	size_t len;
+	uint64_t hash;
+};
+
+struct hb_intern_pool
+{
+	struct hb_arena strings;
+	struct hb_intern_entry *entries;
+	size_t length, cap;
+	// Entry index + 1, 0 is an empty slot.
+	uint32_t *slots;
+	size_t slot_cap;
+};
+
+static _Thread_local struct hb_intern_pool pool;
+
+static void hb_intern_index(struct hb_intern_pool *p, uint32_t id)
+{
+	size_t mask = p->slot_cap - 1;
+	size_t slot = p->entries[id].hash & mask;
+	while (p->slots[slot] != 0) slot = (slot + 1) & mask;
+	p->slots[slot] = id + 1;
+}
+
+static uint32_t hb_intern_add(struct hb_intern_pool *p, const char *str, size_t len,
+		uint64_t hash)
+{
+	char *copy = hb_arena_alloc(&p->strings, len + 1);
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+
+	if (p->length == p->cap) {
+		p->cap = p->cap ? p->cap * 2 : 1024;
+		p->entries = realloc(p->entries, p->cap * sizeof(*p->entries));
+		assert(p->entries != NULL);
+	}
+
+	uint32_t id = (uint32_t) p->length++;
+	p->entries[id] = (struct hb_intern_entry) { copy, len, hash };
+
+	// Slots stay at most half full.
+	if (p->length * 2 > p->slot_cap) {
+		p->slot_cap = p->slot_cap ? p->slot_cap * 2 : 2048;
+		free(p->slots);
+		p->slots = calloc(p->slot_cap, sizeof(*p->slots));
+		assert(p->slots != NULL);
+		for (uint32_t i = 0; i < p->length; ++i)
+			hb_intern_index(p, i);
+	} else {
+		hb_intern_index(p, id);
+	}
+
+	return id;
+}
+
+static struct hb_intern_pool *hb_intern_pool(void)
+{
+	if (pool.length == 0) hb_intern_add(&pool, "", 0, hb_sketch_hash("", 0));
+	return &pool;
+}
+
+uint32_t hb_intern(const char *str, size_t len)
+{
+	struct hb_intern_pool *p = hb_intern_pool();
+	uint64_t hash = hb_sketch_hash(str, len);
+	size_t mask = p->slot_cap - 1;
+
+	for (size_t slot = hash & mask; p->slots[slot] != 0; slot = (slot + 1) & mask) {
+		const struct hb_intern_entry *e = &p->entries[p->slots[slot] - 1];
+		if (e->hash == hash && e->len == len && !memcmp(e->str, str, len))
+			return p->slots[slot] - 1;
+	}
+
+	return hb_intern_add(p, str, len, hash);
+}
+
+uint32_t hb_intern_cstr(const char *str)
+{
+	return hb_intern(str, strlen(str));
+}
+
+uint32_t hb_stream_reader_intern(struct hb_stream_reader *s)
+{
+	struct hb_str_view view = hb_stream_reader_string_view(s);
+	return hb_intern(view.data, view.len);
+}
+
+const char *hb_intern_str(uint32_t id)
+{
+	struct hb_intern_pool *p = hb_intern_pool();
+	assert(id < p->length);
+	return p->entries[id].str;
+}
+
+size_t hb_intern_len(uint32_t id)
+{
+	struct hb_intern_pool *p = hb_intern_pool();
+	assert(id < p->length);
+	return p->entries[id].len;
+}
+
+uint64_t hb_intern_hash(uint32_t id)
+{
+	struct hb_intern_pool *p = hb_intern_pool();
+	assert(id < p->length);
+	return p->entries[id].hash;
+}
+
+void hb_intern_reset(void)
+{
+	hb_arena_reset(&pool.strings);
+	pool.length = 0;
+	if (pool.slots) memset(pool.slots, 0, pool.slot_cap * sizeof(*pool.slots));
+}
+
+void hb_intern_trim(void)
+{
+	if (pool.length > HB_INTERN_MAX_STRINGS) hb_intern_reset();
+}
+
+void hb_intern_free(void)
+{
+	hb_arena_free(&pool.strings);
+	free(pool.entries);
+	free(pool.slots);
+	memset(&pool, 0, sizeof(pool));
+}
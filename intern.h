@@ -0,0 +1,42 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "stream_reader.h"
+
+#define HB_INTERN_MAX_STRINGS (64*1024)
+
+// Every distinct string is stored once and named by a 32 bit id, so equal
+// strings compare as equal ids and hash tables can reuse the stored hash.
+// Id 0 is the empty string. The pool belongs to the calling thread and
+// only grows: ids and the strings behind them stay valid until
+// hb_intern_reset(), hb_intern_trim() or hb_intern_free(), but an id means
+// nothing to another thread. Modes that run for long trim it after every
+// replay, so names that come back in the next replays of a batch are
+// found instead of copied again, and memory is still bounded.
+uint32_t hb_intern(const char *str, size_t len);
+uint32_t hb_intern_cstr(const char *str);
+uint32_t hb_stream_reader_intern(struct hb_stream_reader *s);
+const char *hb_intern_str(uint32_t id);
+size_t hb_intern_len(uint32_t id);
+uint64_t hb_intern_hash(uint32_t id);
+void hb_intern_reset(void);
+// Resets the pool once it holds more than HB_INTERN_MAX_STRINGS strings.
+void hb_intern_trim(void);
+void hb_intern_free(void);
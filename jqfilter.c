@@ -0,0 +1,216 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <assert.h>
+#include <jq.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "events.h"
+#include "hbr.h"
+#include "intern.h"
+#include "jqfilter.h"
+#include "player.h"
+
+struct hb_jq
+{
+	jq_state *state;
+};
+
+struct hb_jq_run
+{
+	struct hb_jq *jq;
+	FILE *out;
+	jv file;
+};
+
+static const char *hb_jq_kinds[HB_EVENT_KIND_COUNT] = {
+	[HB_EVENT_PLAYER_JOIN]         = "player_join",
+	[HB_EVENT_PLAYER_LEAVE]        = "player_leave",
+	[HB_EVENT_PLAYER_CHAT]         = "chat",
+	[HB_EVENT_LOGIC_UPDATE]        = "logic_update",
+	[HB_EVENT_START_MATCH]         = "start_match",
+	[HB_EVENT_STOP_MATCH]          = "stop_match",
+	[HB_EVENT_SET_PLAYER_INPUT]    = "input",
+	[HB_EVENT_SET_PLAYER_TEAM]     = "team",
+	[HB_EVENT_SET_TEAMS_LOCK]      = "teams_lock",
+	[HB_EVENT_SET_GAME_SETTING]    = "game_setting",
+	[HB_EVENT_SET_PLAYER_AVATAR]   = "avatar",
+	[HB_EVENT_SET_PLAYER_DESYNC]   = "desync",
+	[HB_EVENT_SET_PLAYER_ADMIN]    = "admin",
+	[HB_EVENT_SET_STADIUM]         = "stadium",
+	[HB_EVENT_PAUSE_RESUME_GAME]   = "pause",
+	[HB_EVENT_PING_UPDATE]         = "ping",
+	[HB_EVENT_SET_PLAYER_HANDICAP] = "handicap",
+	[HB_EVENT_SET_TEAM_SHIRT]      = "shirt"
+};
+
+static jv hb_jq_team(enum hb_team team)
+{
+	static const char *teams[] = {"spectators", "red", "blue"};
+	return (unsigned) team < sizeof(teams) / sizeof(teams[0]) ? jv_string(teams[team]) : jv_null();
+}
+
+static jv hb_jq_view(struct hb_str_view view)
+{
+	return jv_string_sized(view.data, view.len);
+}
+
+static jv hb_jq_player(const struct hb_player *player)
+{
+	return player ? jv_string(hb_intern_str(player->name)) : jv_null();
+}
+
+static jv hb_jq_set(jv obj, const char *key, jv value)
+{
+	return jv_object_set(obj, jv_string(key), value);
+}
+
+static jv hb_jq_event(struct hbr *hbr, const struct hbr_visit *v, jv file)
+{
+	jv ev = jv_object();
+
+	ev = hb_jq_set(ev, "file", file);
+	ev = hb_jq_set(ev, "frame", jv_number(hbr->current_frame));
+	ev = hb_jq_set(ev, "type", jv_string(hb_jq_kinds[v->type]));
+	ev = hb_jq_set(ev, "by", jv_number(v->by_player));
+	ev = hb_jq_set(ev, "player", hb_jq_player(v->player));
+
+	switch (v->type) {
+	case HB_EVENT_PLAYER_JOIN:
+		ev = hb_jq_set(ev, "id", jv_number(v->player_join.player->id));
+		ev = hb_jq_set(ev, "name", hb_jq_view(v->player_join.name));
+		ev = hb_jq_set(ev, "country", hb_jq_view(v->player_join.country));
+		ev = hb_jq_set(ev, "admin", jv_bool(v->player_join.player->is_admin));
+		break;
+	case HB_EVENT_PLAYER_LEAVE:
+		ev = hb_jq_set(ev, "id", jv_number(v->player_leave.id));
+		ev = hb_jq_set(ev, "name", hb_jq_player(v->player_leave.player));
+		ev = hb_jq_set(ev, "kicked", jv_bool(v->player_leave.kicked));
+		ev = hb_jq_set(ev, "ban", jv_bool(v->player_leave.ban));
+		ev = hb_jq_set(ev, "reason", hb_jq_view(v->player_leave.reason));
+		break;
+	case HB_EVENT_PLAYER_CHAT:
+		ev = hb_jq_set(ev, "message", hb_jq_view(v->player_chat.message));
+		break;
+	case HB_EVENT_SET_PLAYER_INPUT:
+		ev = hb_jq_set(ev, "input", jv_number(v->set_player_input.input));
+		break;
+	case HB_EVENT_SET_PLAYER_TEAM:
+		ev = hb_jq_set(ev, "name", hb_jq_player(v->set_player_team.player));
+		ev = hb_jq_set(ev, "team", hb_jq_team(v->set_player_team.team));
+		break;
+	case HB_EVENT_SET_TEAMS_LOCK:
+		ev = hb_jq_set(ev, "locked", jv_bool(v->set_teams_lock.teams_lock));
+		break;
+	case HB_EVENT_SET_GAME_SETTING:
+		ev = hb_jq_set(ev, "setting", jv_number(v->set_game_setting.setting_id));
+		ev = hb_jq_set(ev, "value", jv_number(v->set_game_setting.setting_value));
+		break;
+	case HB_EVENT_SET_PLAYER_AVATAR:
+		ev = hb_jq_set(ev, "avatar", hb_jq_view(v->set_player_avatar.avatar));
+		break;
+	case HB_EVENT_SET_PLAYER_ADMIN:
+		ev = hb_jq_set(ev, "name", hb_jq_player(v->set_player_admin.player));
+		ev = hb_jq_set(ev, "admin", jv_bool(v->set_player_admin.is_admin));
+		break;
+	case HB_EVENT_SET_STADIUM:
+		ev = hb_jq_set(ev, "stadium", jv_string(v->set_stadium.default_stadium ?
+					v->set_stadium.default_stadium : v->set_stadium.stadium->name));
+		break;
+	case HB_EVENT_PAUSE_RESUME_GAME:
+		ev = hb_jq_set(ev, "paused", jv_bool(v->pause_resume_game.paused));
+		break;
+	case HB_EVENT_PING_UPDATE: {
+		jv pings = jv_array();
+		for (uint8_t i = 0; i < v->ping_update.ping_count; ++i)
+			pings = jv_array_append(pings, jv_number(v->ping_update.pings[i] * 4));
+		ev = hb_jq_set(ev, "pings", pings);
+		break;
+	}
+	case HB_EVENT_SET_PLAYER_HANDICAP:
+		ev = hb_jq_set(ev, "handicap", jv_number(v->set_player_handicap.handicap));
+		break;
+	case HB_EVENT_SET_TEAM_SHIRT: {
+		const struct hb_shirt *shirt = v->set_team_shirt.shirt;
+		jv colors = jv_array();
+		for (size_t i = 0; i < shirt->num_colors; ++i)
+			colors = jv_array_append(colors, jv_number(shirt->colors[i]));
+		ev = hb_jq_set(ev, "team", hb_jq_team(v->set_team_shirt.team));
+		ev = hb_jq_set(ev, "colors", colors);
+		ev = hb_jq_set(ev, "angle", jv_number(shirt->angle));
+		ev = hb_jq_set(ev, "avatar_color", jv_number(shirt->avatar_color));
+		break;
+	}
+	}
+
+	return ev;
+}
+
+static void hb_jq_on_event(struct hbr *hbr, const struct hbr_visit *v, void *data)
+{
+	struct hb_jq_run *run = data;
+	jq_state *state = run->jq->state;
+	jv result;
+
+	jq_start(state, hb_jq_event(hbr, v, jv_copy(run->file)), 0);
+
+	while (jv_is_valid(result = jq_next(state))) {
+		jv_dumpf(result, run->out, 0);
+		fputc('\n', run->out);
+	}
+
+	// An invalid value without a message is the normal end of the results.
+	if (jv_invalid_has_msg(jv_copy(result))) {
+		jv msg = jv_invalid_get_msg(result);
+		if (jv_get_kind(msg) == JV_KIND_STRING) {
+			fprintf(stderr, "jq: error: %s\n", jv_string_value(msg));
+			jv_free(msg);
+		} else {
+			fputs("jq: error: ", stderr);
+			jv_dumpf(msg, stderr, 0);
+			fputc('\n', stderr);
+		}
+	} else {
+		jv_free(result);
+	}
+}
+
+struct hb_jq *hb_jq_compile(const char *program)
+{
+	struct hb_jq *jq = malloc(sizeof(*jq));
+	assert(jq != NULL);
+
+	if (NULL == (jq->state = jq_init()) || !jq_compile(jq->state, program)) {
+		if (jq->state) jq_teardown(&jq->state);
+		free(jq);
+		return NULL;
+	}
+
+	return jq;
+}
+
+void hb_jq_replay(struct hb_jq *jq, struct hbr *hbr, const char *path, FILE *out)
+{
+	struct hb_jq_run run = { jq, out, jv_string(path) };
+	struct hbr_visitor visitor = { .on = { [0 ... HB_EVENT_KIND_COUNT - 1] = hb_jq_on_event }, .data = &run };
+
+	hbr_visit(hbr, &visitor);
+	jv_free(run.file);
+}
+
+void hb_jq_free(struct hb_jq *jq)
+{
+	jq_teardown(&jq->state);
+	free(jq);
+}
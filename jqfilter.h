@@ -0,0 +1,32 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include <stdio.h>
+
+#include "hbr.h"
+
+// A jq program compiled once and run on every event of the replays given
+// to it, each event is handed over as a jv built from the decoded fields.
+// A compiled program belongs to one thread.
+struct hb_jq;
+
+// Compile errors are reported by jq on stderr, NULL is returned then.
+struct hb_jq *hb_jq_compile(const char *program);
+// Runs the program on the remaining events of `hbr` and writes every
+// result as a line of JSON.
+void hb_jq_replay(struct hb_jq *jq, struct hbr *hbr, const char *path, FILE *out);
+void hb_jq_free(struct hb_jq *jq);
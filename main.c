@@ -12,11 +12,32 @@
 // OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
 // CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include "aggregate.h"
+#include "arena.h"
+#include "dedup.h"
+#include "gzwriter.h"
+#include "inflate.h"
+#include "ingest.h"
+#include "intern.h"
+#include "jqfilter.h"
+#include "match.h"
+#include "pack.h"
+#include "server.h"
+#include "timeline.h"
 #include "stream_reader.h"
+#include "tar.h"
 #include "player.h"
 #include "events.h"
 #include "hbr.h"
@@ -24,90 +45,209 @@
 // Comment this if you dont want the stadiums to be storable.
 #define HBR_DUMP_MAKE_STADIUMS_STORABLES
 
-static enum { DumpMessages, DumpStadiums } mode = DumpMessages;
+// No input at all for this long counts as idle.
+#define INPUT_IDLE_SECONDS (10)
 
-static void on_player_join(struct hbr *hbr, struct hb_event_player_join *ev)
+// Replays with fewer inflated bytes of events than this are not worth
+// splitting across threads.
+#define DUMP_SPLIT_MIN_BYTES (4*1024*1024)
+
+static enum { DumpMessages, DumpStadiums, DumpSummary, DumpInputs, DumpMatches, DumpJq } mode = DumpMessages;
+static struct hb_arena arena;
+static struct hb_matcher *matcher;
+// jq states cannot be shared, every decode thread compiles its own once.
+static const char *jq_program;
+static _Thread_local struct hb_jq *jq;
+static struct hb_dedup *dedup;
+// Threads a long replay is split across, 1 in batch mode where the ingest
+// workers already take every job.
+static size_t split_workers;
+// Compressed stdout, or stdout itself.
+static FILE *output;
+// -bundle puts the stadiums into a single tar on the output.
+static bool bundle;
+static struct hb_gzwriter gz;
+static volatile sig_atomic_t stopping;
+
+// Where a replay's output goes, one per decode worker.
+struct dump
+{
+	const char *path;
+	FILE *out;
+	struct hb_input_timelines timelines;
+	unsigned stadiums;
+};
+
+static const char *player_name(const struct hb_player *player)
 {
-	if (mode == DumpMessages)
-		printf("%s joined the room!\n", ev->name);
-	hb_player_list_add(&hbr->player_list, ev->id, ev->name, ev->is_admin, ev->country);
+	return player ? hb_intern_str(player->name) : "";
 }
 
-static void on_player_leave(struct hbr *hbr, uint32_t by_player, struct hb_event_player_leave *ev)
+static void on_player_join(struct hbr *hbr, const struct hbr_visit *v, void *data)
 {
-	if (mode == DumpMessages) {
-		if (!hb_player_list_contains(&hbr->player_list, ev->id)) return;
-		struct hb_player player = hb_player_list_get(&hbr->player_list, ev->id);
-		if (ev->kicked || ev->ban) {
-			struct hb_player by = hb_player_list_get(&hbr->player_list, by_player);
-			printf("%s %s from the room by %s (Reason: %s)\n", player.name, ev->ban ? "banned" : "kicked",
-					by.name, ev->reason);
-		} else {
-			printf("%s left the room!\n", player.name);
-		}
+	const struct dump *d = data;
+	(void) hbr;
+	fprintf(d->out, "%.*s joined the room!\n", v->player_join.name.len, v->player_join.name.data);
+}
+
+static void on_player_leave(struct hbr *hbr, const struct hbr_visit *v, void *data)
+{
+	const struct dump *d = data;
+	(void) hbr;
+	const struct hbr_visit_player_leave *ev = &v->player_leave;
+	if (NULL == ev->player) return;
+	if (ev->kicked || ev->ban) {
+		fprintf(d->out, "%s %s from the room by %s (Reason: %.*s)\n", player_name(ev->player),
+				ev->ban ? "banned" : "kicked", player_name(v->player),
+				ev->reason.len, ev->reason.data);
+	} else {
+		fprintf(d->out, "%s left the room!\n", player_name(ev->player));
 	}
-	hb_player_list_remove(&hbr->player_list, ev->id);
 }
 
-static void on_player_chat(struct hbr *hbr, uint32_t by_player, struct hb_event_player_chat *ev)
+static void on_player_chat(struct hbr *hbr, const struct hbr_visit *v, void *data)
 {
-	if (mode != DumpMessages) return;
-	if (!hb_player_list_contains(&hbr->player_list, by_player)) return;
-	struct hb_player sender = hb_player_list_get(&hbr->player_list, by_player);
-	printf("%s: %s\n", sender.name, ev->message);
+	const struct dump *d = data;
+	(void) hbr;
+	if (NULL == v->player) return;
+	fprintf(d->out, "%s: %.*s\n", player_name(v->player), v->player_chat.message.len, v->player_chat.message.data);
 }
 
-static void on_match_start(struct hbr *hbr, uint32_t by_player)
+static void on_match_start(struct hbr *hbr, const struct hbr_visit *v, void *data)
 {
-	if (mode != DumpMessages) return;
-	if (!hb_player_list_contains(&hbr->player_list, by_player)) return;
-	struct hb_player player = hb_player_list_get(&hbr->player_list, by_player);
-	printf("Game started by %s!\n", player.name);
+	const struct dump *d = data;
+	(void) hbr;
+	if (NULL == v->player) return;
+	fprintf(d->out, "Game started by %s!\n", player_name(v->player));
 }
 
-static void on_match_stop(struct hbr *hbr, uint32_t by_player)
+static void on_match_stop(struct hbr *hbr, const struct hbr_visit *v, void *data)
 {
-	if (mode != DumpMessages) return;
-	if (!hb_player_list_contains(&hbr->player_list, by_player)) return;
-	struct hb_player player = hb_player_list_get(&hbr->player_list, by_player);
-	printf("Game stopped by %s!\n", player.name);
+	const struct dump *d = data;
+	(void) hbr;
+	if (NULL == v->player) return;
+	fprintf(d->out, "Game stopped by %s!\n", player_name(v->player));
 }
 
-static void on_player_admin_change(struct hbr *hbr, uint32_t by_player, struct hb_event_set_player_admin *ev)
+static void on_player_admin_change(struct hbr *hbr, const struct hbr_visit *v, void *data)
 {
-	if (mode != DumpMessages) return;
-	if (!hb_player_list_contains(&hbr->player_list, ev->id)) return;
-	struct hb_player player = hb_player_list_get(&hbr->player_list, ev->id);
-	struct hb_player by = hb_player_list_get(&hbr->player_list, by_player);
-	if (ev->is_admin) printf("%s was given admin rights by %s.\n", player.name, by.name);
-	else printf("%s's admin rights were taken away by %s.\n", player.name, by.name);
+	const struct dump *d = data;
+	(void) hbr;
+	const struct hbr_visit_set_player_admin *ev = &v->set_player_admin;
+	if (NULL == ev->player) return;
+	if (ev->is_admin) fprintf(d->out, "%s was given admin rights by %s.\n", player_name(ev->player), player_name(v->player));
+	else fprintf(d->out, "%s's admin rights were taken away by %s.\n", player_name(ev->player), player_name(v->player));
 }
 
-static void on_player_team_change(struct hbr *hbr, uint32_t by_player, struct hb_event_set_player_team *ev)
+static void on_player_team_change(struct hbr *hbr, const struct hbr_visit *v, void *data)
 {
-	if (mode != DumpMessages) return;
-	if (!hb_player_list_contains(&hbr->player_list, ev->id)) return;
-	struct hb_player player = hb_player_list_get(&hbr->player_list, ev->id);
-	struct hb_player by = hb_player_list_get(&hbr->player_list, by_player);
+	const struct dump *d = data;
+	(void) hbr;
+	const struct hbr_visit_set_player_team *ev = &v->set_player_team;
 	const char *teams[] = {"spectators", "red", "blue"};
-	printf("%s was moved to %s by %s\n", player.name, teams[ev->team], by.name);
+	if (NULL == ev->player) return;
+	fprintf(d->out, "%s was moved to %s by %s\n", player_name(ev->player), teams[ev->team], player_name(v->player));
+}
+
+static void on_game_paused(struct hbr *hbr, const struct hbr_visit *v, void *data)
+{
+	const struct dump *d = data;
+	(void) hbr;
+	if (NULL == v->player) return;
+	fprintf(d->out, "Game %spaused by %s\n", v->pause_resume_game.paused ? "" : "un", player_name(v->player));
+}
+
+static void on_stadium_change(struct hbr *hbr, const struct hbr_visit *v, void *data)
+{
+	const struct dump *d = data;
+	(void) hbr;
+	const struct hbr_visit_set_stadium *ev = &v->set_stadium;
+	if (NULL == v->player) return;
+	fprintf(d->out, "Stadium changed to \"%s\" by %s\n",
+			ev->default_stadium ? ev->default_stadium : ev->stadium->name,
+			player_name(v->player));
+}
+
+static void on_input_player_join(struct hbr *hbr, const struct hbr_visit *v, void *data)
+{
+	struct dump *d = data;
+	hb_input_timeline_begin(hb_input_timelines_get(&d->timelines, v->player_join.player->id),
+			v->player_join.player->name, hbr->current_frame, 0);
+}
+
+static void on_input_player_leave(struct hbr *hbr, const struct hbr_visit *v, void *data)
+{
+	struct dump *d = data;
+	hb_input_timeline_end(hb_input_timelines_get(&d->timelines, v->player_leave.id), hbr->current_frame);
 }
 
-static void on_game_paused(struct hbr *hbr, uint32_t by_player, struct hb_event_pause_resume_game *ev)
+static void on_input_change(struct hbr *hbr, const struct hbr_visit *v, void *data)
 {
-	if (mode != DumpMessages) return;
-	if (!hb_player_list_contains(&hbr->player_list, by_player)) return;
-	struct hb_player player = hb_player_list_get(&hbr->player_list, by_player);
-	printf("Game %spaused by %s\n", ev->paused ? "" : "un", player.name);
+	struct dump *d = data;
+	hb_input_timeline_record(hb_input_timelines_get(&d->timelines, v->by_player),
+			hbr->current_frame, v->set_player_input.input);
 }
 
-static void save_stadium(struct hb_stadium *stadium)
+struct match_hit
+{
+	const struct dump *dump;
+	const char *name, *what;
+	uint32_t frame;
+	struct hb_str_view text;
+};
+
+static bool on_match(const struct hb_matcher *m, uint32_t pattern, size_t end, void *data)
+{
+	const struct match_hit *hit = data;
+	(void) end;
+	fprintf(hit->dump->out, "%s:%u: %s: %s matches \"%s\": %.*s\n", hit->dump->path, hit->frame, hit->name,
+			hit->what, m->patterns[pattern], hit->text.len, hit->text.data);
+	// One line per text is enough, whatever else it matches.
+	return false;
+}
+
+static void match_text(struct hbr *hbr, const struct dump *d, const struct hb_player *player,
+		const char *what, struct hb_str_view text)
+{
+	struct match_hit hit = { d, player_name(player), what, hbr->current_frame, text };
+	hb_matcher_scan(matcher, text.data, text.len, on_match, &hit);
+}
+
+static void on_match_player_join(struct hbr *hbr, const struct hbr_visit *v, void *data)
+{
+	match_text(hbr, data, v->player_join.player, "name", v->player_join.name);
+}
+
+static void on_match_player_leave(struct hbr *hbr, const struct hbr_visit *v, void *data)
+{
+	if (v->player_leave.kicked)
+		match_text(hbr, data, v->player, v->player_leave.ban ? "ban reason" : "kick reason",
+				v->player_leave.reason);
+}
+
+static void on_match_player_chat(struct hbr *hbr, const struct hbr_visit *v, void *data)
+{
+	match_text(hbr, data, v->player, "chat", v->player_chat.message);
+}
+
+// Bundled stadiums are named after their replay, loose ones get a random
+// file name each.
+static void save_stadium(struct dump *d, struct hb_stadium *stadium, unsigned index)
 {
 #ifdef HBR_DUMP_MAKE_STADIUMS_STORABLES
 	stadium->can_be_stored = true;
 #endif
 	char *hbs_data = hb_stadium_to_str(stadium);
 	char filename[256];
+
+	if (bundle) {
+		const char *base = strrchr(d->path, '/') ? strrchr(d->path, '/') + 1 : d->path;
+		snprintf(filename, sizeof(filename), "%s.%u.hbs", base, index);
+		hb_tar_put(d->out, filename, hbs_data, strlen(hbs_data));
+		free(hbs_data);
+		return;
+	}
+
 	snprintf(filename, sizeof(filename), "%05d.hbs", rand() % 100000);
 	FILE *fp = fopen(filename, "w");
 	fputs(hbs_data, fp);
@@ -115,64 +255,674 @@ static void save_stadium(struct hb_stadium *stadium)
 	free(hbs_data);
 }
 
-static void on_stadium_change(struct hbr *hbr, uint32_t by_player, struct hb_event_set_stadium *ev)
+static void on_stadium_save(struct hbr *hbr, const struct hbr_visit *v, void *data)
 {
-	struct hb_player player = hb_player_list_get(&hbr->player_list, by_player);
-	if (!hb_player_list_contains(&hbr->player_list, by_player)) return;
-	if (mode == DumpMessages) {
-		printf("Stadium changed to \"%s\" by %s\n",
-				ev->default_stadium ? ev->default_stadium : ev->stadium.name,
-				player.name);
-	} else if (NULL == ev->default_stadium){
-		save_stadium(&ev->stadium);
+	struct dump *d = data;
+	unsigned index = ++d->stadiums;
+	(void) hbr;
+	if (NULL == v->player || v->set_stadium.default_stadium) return;
+	save_stadium(d, v->set_stadium.stadium, index);
+}
+
+static const struct hbr_visitor visitors[] = {
+	[DumpMessages] = { .on = {
+		[HB_EVENT_PLAYER_JOIN]       = on_player_join,
+		[HB_EVENT_PLAYER_LEAVE]      = on_player_leave,
+		[HB_EVENT_PLAYER_CHAT]       = on_player_chat,
+		[HB_EVENT_START_MATCH]       = on_match_start,
+		[HB_EVENT_STOP_MATCH]        = on_match_stop,
+		[HB_EVENT_SET_PLAYER_ADMIN]  = on_player_admin_change,
+		[HB_EVENT_SET_PLAYER_TEAM]   = on_player_team_change,
+		[HB_EVENT_PAUSE_RESUME_GAME] = on_game_paused,
+		[HB_EVENT_SET_STADIUM]       = on_stadium_change
+	} },
+	[DumpStadiums] = { .on = {
+		[HB_EVENT_SET_STADIUM]       = on_stadium_save
+	} },
+	[DumpSummary] = { .on = { NULL } },
+	[DumpInputs] = { .on = {
+		[HB_EVENT_PLAYER_JOIN]       = on_input_player_join,
+		[HB_EVENT_PLAYER_LEAVE]      = on_input_player_leave,
+		[HB_EVENT_SET_PLAYER_INPUT]  = on_input_change
+	} },
+	[DumpMatches] = { .on = {
+		[HB_EVENT_PLAYER_JOIN]       = on_match_player_join,
+		[HB_EVENT_PLAYER_LEAVE]      = on_match_player_leave,
+		[HB_EVENT_PLAYER_CHAT]       = on_match_player_chat
+	} },
+	[DumpJq] = { .on = { NULL } }
+};
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int inflate_bench(const char *path)
+{
+	static const struct hb_inflate_backend *backends[] = {
+		&hb_inflate_backend_zlib, &hb_inflate_backend_fast
+	};
+
+	struct hb_stream_reader *s = hb_stream_reader_from_file(NULL, path);
+	struct hb_inflate_buf reference = { .max = SIZE_MAX };
+	int status = 0;
+
+	// Skip version, magic and total frames, the rest is the zlib body.
+	const uint8_t *in = &s->data[12];
+	size_t len = s->len - 12;
+
+	hb_inflate_buf_reserve(&reference, 1);
+	if (hb_inflate_backend_zlib.inflate(in, len, false, &reference) != HB_INFLATE_OK) {
+		printf("Invalid replay!\n");
+		hb_stream_reader_free(s);
+		return 1;
+	}
+
+	for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); ++i) {
+		struct hb_inflate_buf out = { .cap = reference.len, .max = reference.len };
+		size_t iterations = 0;
+		bool identical = true;
+		double start = now(), elapsed;
+
+		out.data = malloc(reference.len);
+
+		do {
+			out.len = 0;
+			identical &= backends[i]->inflate(in, len, false, &out) == HB_INFLATE_OK &&
+				out.len == reference.len && !memcmp(out.data, reference.data, out.len);
+			++iterations;
+		} while ((elapsed = now() - start) < 1.0);
+
+		printf("%-5s %8.1f MB/s %s\n", backends[i]->name,
+				(reference.len * iterations) / elapsed / (1024.0 * 1024.0),
+				identical ? "identical" : "MISMATCH");
+
+		if (!identical) status = 1;
+		free(out.data);
 	}
+
+	free(reference.data);
+	hb_stream_reader_free(s);
+	return status;
 }
 
-int
-main(int argc, char **argv)
+static bool set_mode(const char *option)
 {
-	if (argc <= 2) return 1;
+	if (!strcmp(option, "-messages")) mode = DumpMessages;
+	else if (!strcmp(option, "-stadiums")) mode = DumpStadiums;
+	else if (!strcmp(option, "-bundle")) { mode = DumpStadiums; bundle = true; }
+	else if (!strcmp(option, "-summary")) mode = DumpSummary;
+	else if (!strcmp(option, "-inputs")) mode = DumpInputs;
+	else return false;
+	return true;
+}
 
-	if (!strcmp(argv[1], "-messages")) mode = DumpMessages;
-	else if (!strcmp(argv[1], "-stadiums")) mode = DumpStadiums;
-	else { printf("Invalid option!\n"); return 1; }
+static void dump_inputs(struct dump *d, struct hbr *hbr)
+{
+	for (size_t i = 0; i < d->timelines.length; ++i) {
+		struct hb_input_timeline *tl = &d->timelines.players[i];
+		struct hb_input_stats stats;
 
-	struct hbr *hbr = hbr_parse(argv[2]);
-	struct hb_event ev = {0};
+		if (tl->length == 0) continue;
+		if (tl->present) hb_input_timeline_end(tl, hbr->current_frame);
 
-	srand((unsigned ) getpid());
+		hb_input_timeline_stats(tl, INPUT_IDLE_SECONDS * HB_FRAMES_PER_SECOND, &stats);
+		if (stats.frames == 0) continue;
+
+		double minutes = stats.frames / (60.0 * HB_FRAMES_PER_SECOND);
+		fprintf(d->out, "%s: %.1f s, %u kicks (%.1f/min), %u actions (%.1f/min), "
+				"idle %.1f s (longest %.1f s)\n",
+				hb_intern_str(tl->name), stats.frames / (double) HB_FRAMES_PER_SECOND,
+				stats.kicks, stats.kicks / minutes,
+				stats.actions, stats.actions / minutes,
+				stats.idle_frames / (double) HB_FRAMES_PER_SECOND,
+				stats.longest_idle / (double) HB_FRAMES_PER_SECOND);
+	}
+
+	hb_input_timelines_reset(&d->timelines);
+}
+
+struct split_job
+{
+	const char *path;
+	const struct hbr *hbr;
+	const struct hbr_split *split;
+	char **texts;
+	size_t *lens;
+	size_t next;
+};
+
+static void *dump_segments(void *arg)
+{
+	struct split_job *job = arg;
+	struct hb_arena segment_arena = {0};
+	struct dump d = {0};
+	struct hbr_visitor visitor = visitors[mode];
+	size_t i;
+
+	d.path = job->path;
+	visitor.data = &d;
+	while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->split->length) {
+		struct hbr *part = hbr_segment_open(job->hbr, job->split, i, &segment_arena);
+		d.out = open_memstream(&job->texts[i], &job->lens[i]);
+		assert(d.out != NULL);
+		d.stadiums = job->split->segments[i].event_counts[HB_EVENT_SET_STADIUM];
+		hbr_visit(part, &visitor);
+		fclose(d.out);
+		hb_arena_reset(&segment_arena);
+	}
+
+	hb_arena_free(&segment_arena);
+	hb_intern_free();
+	return NULL;
+}
+
+// A skip-scan cuts the replay at match boundaries, the segments are then
+// visited on threads of their own and their output written in order.
+static void dump_split(struct dump *d, struct hbr *hbr)
+{
+	size_t remaining = hbr->stream->len - hbr->stream->offset;
+	size_t min_len = remaining / (split_workers * 4);
+	struct split_job job = { d->path, hbr, NULL, NULL, NULL, 0 };
+	struct hbr_split split;
+
+	hbr_split(hbr, min_len, &split);
+	job.split = &split;
+	job.texts = calloc(split.length, sizeof(*job.texts));
+	job.lens = calloc(split.length, sizeof(*job.lens));
+	assert(job.texts != NULL && job.lens != NULL);
+
+	size_t threads = split.length < split_workers ? split.length : split_workers;
+	pthread_t *thread = malloc(threads * sizeof(*thread));
+	assert(thread != NULL);
+	for (size_t i = 0; i < threads; ++i) {
+		if (pthread_create(&thread[i], NULL, dump_segments, &job) != 0) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (size_t i = 0; i < threads; ++i)
+		pthread_join(thread[i], NULL);
+
+	for (size_t i = 0; i < split.length; ++i) {
+		fwrite(job.texts[i], 1, job.lens[i], d->out);
+		free(job.texts[i]);
+	}
+
+	free(thread);
+	free(job.texts);
+	free(job.lens);
+	hbr_split_free(&split);
+}
+
+static void dump_hbr(struct dump *d, struct hbr *hbr)
+{
+	struct hbr_visitor visitor = visitors[mode];
+	size_t initial_players = hbr->player_list.length;
+
+	visitor.data = d;
+	d->stadiums = 0;
 
 	if (mode == DumpStadiums && hbr->default_stadium == NULL) {
-		save_stadium(&hbr->stadium);
+		save_stadium(d, &hbr->stadium, 0);
+	}
+
+	if (mode == DumpInputs) {
+		for (size_t i = 0; i < hbr->player_list.length; ++i) {
+			struct hb_player *player = &hbr->player_list.players[i];
+			hb_input_timeline_begin(hb_input_timelines_get(&d->timelines, player->id),
+					player->name, 0, (uint8_t) player->input);
+		}
 	}
 
 	if (mode == DumpMessages) {
-		printf("Room name: %s\n", hbr->room_name);
-		printf("Stadium: %s.\n", hbr->default_stadium != NULL ? hbr->default_stadium : hbr->stadium.name);
-		printf("Player list: [\n");
+		fprintf(d->out, "Room name: %s\n", hb_intern_str(hbr->room_name));
+		fprintf(d->out, "Stadium: %s.\n", hbr->default_stadium != NULL ? hbr->default_stadium : hbr->stadium.name);
+		fprintf(d->out, "Player list: [\n");
 		for (size_t i = 0; i < hbr->player_list.length; ++i)
-			printf("	{ name=%s country=%s avatar=%s },\n",
-					hbr->player_list.players[i].name,
-					hbr->player_list.players[i].country,
-					hbr->player_list.players[i].avatar);
-		printf("]\n");
-	}
-
-	while (hbr_next_event(hbr, &ev) > 0) {
-		switch (ev.type) {
-		case HB_EVENT_PLAYER_JOIN: on_player_join(hbr, &ev.player_join); break;
-		case HB_EVENT_PLAYER_LEAVE: on_player_leave(hbr, ev.by_player, &ev.player_leave); break;
-		case HB_EVENT_PLAYER_CHAT: on_player_chat(hbr, ev.by_player, &ev.player_chat); break;
-		case HB_EVENT_START_MATCH: on_match_start(hbr, ev.by_player); break;
-		case HB_EVENT_STOP_MATCH: on_match_stop(hbr, ev.by_player); break;
-		case HB_EVENT_SET_PLAYER_ADMIN: on_player_admin_change(hbr, ev.by_player, &ev.set_player_admin); break;
-		case HB_EVENT_SET_PLAYER_TEAM: on_player_team_change(hbr, ev.by_player, &ev.set_player_team); break;
-		case HB_EVENT_PAUSE_RESUME_GAME: on_game_paused(hbr, ev.by_player, &ev.pause_resume_game); break;
-		case HB_EVENT_SET_STADIUM: on_stadium_change(hbr, ev.by_player, &ev.set_stadium); break;
+			fprintf(d->out, "	{ name=%s country=%s avatar=%s },\n",
+					hb_intern_str(hbr->player_list.players[i].name),
+					hb_intern_str(hbr->player_list.players[i].country),
+					hb_intern_str(hbr->player_list.players[i].avatar));
+		fprintf(d->out, "]\n");
+	}
+
+	if (mode == DumpMatches) {
+		for (size_t i = 0; i < hbr->player_list.length; ++i) {
+			struct hb_player *player = &hbr->player_list.players[i];
+			struct hb_str_view name = { hb_intern_str(player->name), (uint16_t) hb_intern_len(player->name) };
+			match_text(hbr, d, player, "name", name);
+		}
+	}
+
+	// Input timelines run across matches and jq states are per thread, those
+	// replays stay serial.
+	if (mode == DumpJq) {
+		if (NULL == jq) jq = hb_jq_compile(jq_program);
+		assert(jq != NULL);
+		hb_jq_replay(jq, hbr, d->path, d->out);
+	} else if (split_workers > 1 && NULL == hbr->pack && mode != DumpInputs && mode != DumpSummary &&
+			hbr->stream->len - hbr->stream->offset >= DUMP_SPLIT_MIN_BYTES) {
+		dump_split(d, hbr);
+	} else {
+		hbr_visit(hbr, &visitor);
+	}
+
+	if (mode == DumpInputs)
+		dump_inputs(d, hbr);
+
+	if (mode == DumpSummary) {
+		fprintf(d->out, "%s: room \"%s\", version %u, %.1f s, %zu players, "
+				"%u joins, %u chat messages, %u matches, %u stadium changes\n",
+				d->path, hb_intern_str(hbr->room_name), hbr->version,
+				hbr->total_frames / (double) HB_FRAMES_PER_SECOND,
+				initial_players, hbr->event_counts[HB_EVENT_PLAYER_JOIN],
+				hbr->event_counts[HB_EVENT_PLAYER_CHAT], hbr->event_counts[HB_EVENT_START_MATCH],
+				hbr->event_counts[HB_EVENT_SET_STADIUM]);
+	}
+}
+
+// Also pushes the compressed output out, up to a point it can be read to.
+static void dump_flush(void)
+{
+	fflush(output);
+	if (output != stdout) hb_gzwriter_flush(&gz);
+}
+
+static void dump_duplicate(struct dump *d)
+{
+	if (mode == DumpSummary) fprintf(d->out, "%s: duplicate, skipped\n", d->path);
+}
+
+static void dump_invalid(const char *path)
+{
+	fprintf(stderr, "%s: invalid or unsupported replay\n", path);
+}
+
+enum dump_status { DumpDone, DumpDuplicate, DumpInvalid };
+
+static enum dump_status dump_replay(struct dump *d, const char *path)
+{
+	struct hb_fingerprint fp = {0};
+	struct hbr *hbr;
+
+	d->path = path;
+
+	if (dedup) {
+		struct hb_stream_reader *s = hb_stream_reader_from_file(&arena, path);
+		fp = hb_fingerprint(s->data, s->len);
+		if (hb_dedup_check(dedup, fp)) {
+			dump_duplicate(d);
+			hb_arena_reset(&arena);
+			return DumpDuplicate;
 		}
+		hbr = hbr_parse_buffer(s->data, s->len, &arena);
+	} else {
+		hbr = hbr_parse_arena(path, &arena);
+	}
+
+	if (NULL == hbr) {
+		dump_invalid(path);
+		hb_arena_reset(&arena);
+		return DumpInvalid;
 	}
 
+	dump_hbr(d, hbr);
+	bool failed = hbr_failed(hbr);
 	hbr_free(hbr);
+	hb_arena_reset(&arena);
+	hb_intern_trim();
+
+	if (failed) {
+		dump_invalid(path);
+		return DumpInvalid;
+	}
+
+	if (dedup) {
+		dump_flush();
+		hb_dedup_commit(dedup, fp);
+	}
+
+	return DumpDone;
+}
+
+struct dump_worker
+{
+	struct dump dump;
+	struct hb_arena arena;
+};
+
+// Workers finish out of order, each replay's output is held back until
+// the ones given before it are written.
+static struct
+{
+	pthread_mutex_t lock;
+	struct { char *data; size_t len; bool commit; struct hb_fingerprint fp; } *outputs;
+	size_t next, count;
+} ordered = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+// A fingerprint only goes to the set once the output of its replay is out.
+static void dump_emit(size_t index, char *data, size_t len, const struct hb_fingerprint *fp)
+{
+	pthread_mutex_lock(&ordered.lock);
+	size_t first = ordered.next;
+	ordered.outputs[index].data = data;
+	ordered.outputs[index].len = len;
+	if (fp) {
+		ordered.outputs[index].commit = true;
+		ordered.outputs[index].fp = *fp;
+	}
+	while (ordered.next < ordered.count && ordered.outputs[ordered.next].data != NULL) {
+		fwrite(ordered.outputs[ordered.next].data, 1, ordered.outputs[ordered.next].len, output);
+		free(ordered.outputs[ordered.next].data);
+		ordered.next += 1;
+	}
+	if (dedup && ordered.next > first) {
+		dump_flush();
+		for (size_t i = first; i < ordered.next; ++i)
+			if (ordered.outputs[i].commit) hb_dedup_commit(dedup, ordered.outputs[i].fp);
+	}
+	pthread_mutex_unlock(&ordered.lock);
+}
+
+static void dump_ingested(struct hb_ingest_file *file, size_t worker, void *data)
+{
+	struct dump_worker *w = &((struct dump_worker *) data)[worker];
+	struct hb_fingerprint fp = {0};
+	bool dumped = false;
+	char *text = NULL;
+	size_t len = 0;
+
+	w->dump.path = file->path;
+	w->dump.out = open_memstream(&text, &len);
+	assert(w->dump.out != NULL);
+
+	if (file->data && dedup) fp = hb_fingerprint(file->data, file->len);
+
+	if (file->data && dedup && hb_dedup_check(dedup, fp)) {
+		dump_duplicate(&w->dump);
+	} else if (file->data) {
+		struct hbr *hbr = hbr_parse_buffer(file->data, file->len, &w->arena);
+		if (hbr) {
+			dump_hbr(&w->dump, hbr);
+			dumped = !hbr_failed(hbr);
+			hbr_free(hbr);
+		}
+		if (!dumped) dump_invalid(file->path);
+		hb_arena_reset(&w->arena);
+		hb_intern_trim();
+	} else {
+		fprintf(stderr, "%s: %s\n", file->path, strerror(file->error));
+	}
+
+	fclose(w->dump.out);
+	dump_emit(file->index, text, len, dedup && dumped ? &fp : NULL);
+}
+
+static void dump_worker_done(size_t worker, void *data)
+{
+	struct dump_worker *w = &((struct dump_worker *) data)[worker];
+	hb_arena_free(&w->arena);
+	hb_input_timelines_free(&w->dump.timelines);
+	hb_intern_free();
+	if (jq) hb_jq_free(jq);
+}
+
+static void dump_replays(struct hb_ingest *ingest, const char *const *paths, size_t count)
+{
+	struct dump_worker *workers = calloc(ingest->workers, sizeof(*workers));
+
+	ordered.outputs = calloc(count, sizeof(*ordered.outputs));
+	ordered.count = count;
+	assert(workers != NULL && ordered.outputs != NULL);
+
+	split_workers = 1;
+	ingest->fn = dump_ingested;
+	ingest->done = dump_worker_done;
+	ingest->data = workers;
+	hb_ingest_run(ingest, paths, count);
+
+	free(ordered.outputs);
+	free(workers);
+}
+
+static bool is_replay_name(const char *name)
+{
+	const char *ext = strrchr(name, '.');
+	return ext != NULL && (!strcmp(ext, ".hbr") || !strcmp(ext, ".hbrp"));
+}
+
+static void stop(int sig)
+{
+	(void) sig;
+	stopping = 1;
+}
+
+// Runs until SIGINT or SIGTERM, which let main() finish the output.
+static int watch(struct dump *d, const char *dir)
+{
+	static const char *verbs[] = {
+		[DumpDone] = "process", [DumpDuplicate] = "skip a duplicate", [DumpInvalid] = "reject"
+	};
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	char path[PATH_MAX];
+	struct stat st;
+	struct sigaction sa = { .sa_handler = stop };
+	int fd = inotify_init1(IN_CLOEXEC);
+
+	if (fd == -1 || inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+		perror("inotify");
+		return 1;
+	}
+
+	// No SA_RESTART, the blocking read returns on either.
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	while (!stopping) {
+		ssize_t len = read(fd, buf, sizeof(buf));
+
+		if (len == -1 && errno == EINTR) continue;
+		if (len <= 0) { perror("read"); close(fd); return 1; }
+
+		for (char *p = buf; p < buf + len; ) {
+			const struct inotify_event *ev = (const struct inotify_event *) p;
+			p += sizeof(struct inotify_event) + ev->len;
+
+			if (ev->len == 0 || !is_replay_name(ev->name)) continue;
+			snprintf(path, sizeof(path), "%s/%s", dir, ev->name);
+			if (stat(path, &st) == -1) continue;
+
+			double start = now();
+			enum dump_status status = dump_replay(d, path);
+			dump_flush();
+
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME, &ts);
+			fprintf(stderr, "%s: %.1f ms to %s, %.1f ms since written\n", path,
+					(now() - start) * 1000.0, verbs[status],
+					((ts.tv_sec - st.st_mtim.tv_sec) * 1e3) +
+					((ts.tv_nsec - st.st_mtim.tv_nsec) / 1e6));
+		}
+	}
+
+	close(fd);
+	return 0;
+}
+
+// Ends the tar bundle, then the gzip stream around it.
+static void close_output(void)
+{
+	if (bundle) hb_tar_end(output);
+	if (output != stdout) fclose(output);
+}
+
+// Loose stadium files never go through the output, so there is nothing
+// for -gzip to compress.
+static bool output_applies(void)
+{
+	if (output == stdout || mode != DumpStadiums || bundle) return true;
+	printf("Option -gzip does not apply to -stadiums, use -bundle!\n");
+	return false;
+}
+
+int
+main(int argc, char **argv)
+{
+	static struct dump serial;
+	static struct hb_dedup seen;
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	struct hb_ingest ingest = { .depth = HB_INGEST_DEPTH, .budget = HB_INGEST_BUDGET };
+
+	for (;;) {
+		if (argc > 3 && !strcmp(argv[1], "-inflate")) {
+			const struct hb_inflate_backend *backend = hb_inflate_backend_find(argv[2]);
+			if (NULL == backend) { printf("Invalid inflate backend!\n"); return 1; }
+			hb_inflate_backend_set(backend);
+		} else if (argc > 3 && !strcmp(argv[1], "-jobs")) {
+			jobs = atol(argv[2]);
+		} else if (argc > 3 && !strcmp(argv[1], "-budget")) {
+			ingest.budget = (size_t) atol(argv[2]) * 1024 * 1024;
+		} else if (argc > 3 && !strcmp(argv[1], "-dedup")) {
+			if (!hb_dedup_open(&seen, argv[2])) { printf("Invalid fingerprint set!\n"); return 1; }
+			dedup = &seen;
+		} else if (argc > 3 && !strcmp(argv[1], "-gzip")) {
+			int level = atoi(argv[2]);
+			if (level < 1 || level > 9 || !hb_gzwriter_open(&gz, stdout, level) ||
+					NULL == (output = hb_gzwriter_fopen(&gz))) {
+				printf("Invalid compression level!\n");
+				return 1;
+			}
+		} else {
+			break;
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
+	ingest.workers = split_workers = jobs > 0 ? (size_t) jobs : 1;
+	if (NULL == output) output = stdout;
+	serial.out = output;
+
+	if (argc <= 2) return 1;
+
+	srand((unsigned ) getpid());
+
+	if (output != stdout && (!strcmp(argv[1], "-inflate-bench") || !strcmp(argv[1], "-pack") ||
+				!strcmp(argv[1], "-serve") || !strcmp(argv[1], "-aggregate"))) {
+		printf("Option -gzip does not apply to %s!\n", argv[1]);
+		return 1;
+	}
+
+	if (!strcmp(argv[1], "-inflate-bench")) return inflate_bench(argv[2]);
+
+	if (!strcmp(argv[1], "-pack")) {
+		enum hbr_pack_codec codec = HBR_PACK_CODEC_NONE;
+		if (argc <= 3) return 1;
+		if (argc > 4 && !strcmp(argv[4], "deflate")) codec = HBR_PACK_CODEC_DEFLATE;
+		else if (argc > 4 && strcmp(argv[4], "none")) { printf("Invalid codec!\n"); return 1; }
+		if (!hbr_pack_write(argv[2], argv[3], codec)) { printf("Could not pack %s!\n", argv[2]); return 1; }
+		return 0;
+	}
+
+	if (!strcmp(argv[1], "-serve")) {
+		long workers = argc > 3 ? atol(argv[3]) : sysconf(_SC_NPROCESSORS_ONLN);
+		return hbr_serve(argv[2], workers > 0 ? (size_t) workers : 1);
+	}
+
+	if (!strcmp(argv[1], "-watch")) {
+		if (argc > 3 && !set_mode(argv[3])) { printf("Invalid option!\n"); return 1; }
+		if (!output_applies()) return 1;
+		int status = watch(&serial, argv[2]);
+		close_output();
+		return status;
+	}
+
+	if (!strcmp(argv[1], "-aggregate")) {
+		if (argc <= 3) return 1;
+		struct hb_aggregate *agg = malloc(sizeof(*agg));
+		assert(agg != NULL);
+		hb_aggregate_init(agg);
+		for (int i = 3; i < argc; ++i) {
+			struct hbr *hbr = hbr_parse_arena(argv[i], &arena);
+			if (hbr) hb_aggregate_replay(agg, hbr);
+			if (NULL == hbr || hbr_failed(hbr)) dump_invalid(argv[i]);
+			if (hbr) hbr_free(hbr);
+			hb_arena_reset(&arena);
+			hb_intern_reset();
+		}
+		hb_aggregate_write(agg, argv[2]);
+		hb_aggregate_free(agg);
+		free(agg);
+		hb_arena_free(&arena);
+		hb_intern_free();
+		return 0;
+	}
+
+	if (!strcmp(argv[1], "-reduce")) {
+		struct hb_aggregate *agg = malloc(sizeof(*agg)), *partial = malloc(sizeof(*partial));
+		assert(agg != NULL && partial != NULL);
+		hb_aggregate_init(agg);
+		for (int i = 2; i < argc; ++i) {
+			hb_aggregate_init(partial);
+			if (!hb_aggregate_read(partial, argv[i])) {
+				printf("Invalid partial aggregate %s!\n", argv[i]);
+				return 1;
+			}
+			hb_aggregate_merge(agg, partial);
+			hb_aggregate_free(partial);
+		}
+		hb_aggregate_print(agg, output);
+		close_output();
+		hb_aggregate_free(agg);
+		free(agg);
+		free(partial);
+		return 0;
+	}
+
+	if (!strcmp(argv[1], "-match")) {
+		if (argc <= 3 || NULL == (matcher = hb_matcher_from_file(argv[2]))) {
+			printf("Invalid pattern file!\n");
+			return 1;
+		}
+		mode = DumpMatches;
+		argc -= 1;
+		argv += 1;
+	} else if (!strcmp(argv[1], "-jq")) {
+		if (argc <= 3 || NULL == (jq = hb_jq_compile(argv[2]))) {
+			printf("Invalid jq program!\n");
+			return 1;
+		}
+		jq_program = argv[2];
+		mode = DumpJq;
+		argc -= 1;
+		argv += 1;
+	} else if (!set_mode(argv[1])) {
+		printf("Invalid option!\n");
+		return 1;
+	}
+
+	if (!output_applies()) return 1;
+
+	if (argc > 3) dump_replays(&ingest, (const char *const *) &argv[2], (size_t)(argc - 2));
+	else dump_replay(&serial, argv[2]);
+
+	if (dedup) {
+		fprintf(mode == DumpSummary ? output : stderr, "%zu duplicates skipped, %zu new replays\n",
+				dedup->hits, dedup->misses);
+		hb_dedup_close(dedup);
+	}
+
+	close_output();
+
+	hb_arena_free(&arena);
+	hb_input_timelines_free(&serial.timelines);
+	hb_intern_free();
+	if (matcher) hb_matcher_free(matcher);
+	if (jq) hb_jq_free(jq);
 
 	return 0;
 }
@@ -0,0 +1,245 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "match.h"
+
+#define HB_MATCH_NONE (UINT32_MAX)
+
+static uint8_t hb_match_fold(uint8_t c)
+{
+	return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+static uint32_t hb_matcher_new_state(struct hb_matcher *m)
+{
+	if (m->state_count == m->state_cap) {
+		m->state_cap = m->state_cap ? m->state_cap * 2 : 256;
+		m->next = realloc(m->next, m->state_cap * m->class_count * sizeof(*m->next));
+		m->match = realloc(m->match, m->state_cap * sizeof(*m->match));
+		m->dict = realloc(m->dict, m->state_cap * sizeof(*m->dict));
+		assert(m->next != NULL && m->match != NULL && m->dict != NULL);
+	}
+
+	uint32_t state = (uint32_t) m->state_count++;
+	for (uint32_t c = 0; c < m->class_count; ++c)
+		m->next[state * m->class_count + c] = HB_MATCH_NONE;
+	m->match[state] = m->dict[state] = HB_MATCH_NONE;
+	return state;
+}
+
+static void hb_matcher_add(struct hb_matcher *m, uint32_t pattern)
+{
+	const uint8_t *p = (const uint8_t *) m->patterns[pattern];
+	uint32_t state = 0;
+
+	for (; *p; ++p) {
+		uint32_t *next = &m->next[state * m->class_count + m->classes[*p]];
+		if (*next == HB_MATCH_NONE) {
+			uint32_t child = hb_matcher_new_state(m);
+			// new_state may have moved the table.
+			next = &m->next[state * m->class_count + m->classes[*p]];
+			*next = child;
+		}
+		state = *next;
+	}
+
+	// The same phrase twice only reports the first one.
+	if (m->match[state] == HB_MATCH_NONE) m->match[state] = pattern;
+}
+
+// Turns the trie into a DFA: missing transitions take the one of the
+// failure state, computed breadth first so it is always complete already.
+static void hb_matcher_link(struct hb_matcher *m)
+{
+	uint32_t *queue = malloc(m->state_count * sizeof(*queue));
+	uint32_t *fail = malloc(m->state_count * sizeof(*fail));
+	size_t head = 0, tail = 0;
+	assert(queue != NULL && fail != NULL);
+
+	for (uint32_t c = 0; c < m->class_count; ++c) {
+		uint32_t *next = &m->next[c];
+		if (*next == HB_MATCH_NONE) {
+			*next = 0;
+		} else {
+			fail[*next] = 0;
+			queue[tail++] = *next;
+		}
+	}
+
+	while (head < tail) {
+		uint32_t state = queue[head++];
+		for (uint32_t c = 0; c < m->class_count; ++c) {
+			uint32_t *next = &m->next[state * m->class_count + c];
+			uint32_t via_fail = m->next[fail[state] * m->class_count + c];
+			if (*next == HB_MATCH_NONE) {
+				*next = via_fail;
+				continue;
+			}
+			fail[*next] = via_fail;
+			m->dict[*next] = m->match[via_fail] != HB_MATCH_NONE ? via_fail : m->dict[via_fail];
+			queue[tail++] = *next;
+		}
+	}
+
+	free(queue);
+	free(fail);
+}
+
+static void hb_matcher_set_starts(struct hb_matcher *m)
+{
+	for (size_t i = 0; i < m->pattern_count; ++i) {
+		uint8_t c = hb_match_fold((uint8_t) m->patterns[i][0]);
+		m->starts[c] = true;
+		if (c >= 'a' && c <= 'z') m->starts[c - ('a' - 'A')] = true;
+	}
+
+	// Shufti buckets by high nibble modulo 8: a byte is a candidate when
+	// its low nibble was seen in the bucket of its high nibble. Nibbles 8
+	// apart share a bucket, the few false positives this gives are
+	// rejected with `starts`.
+	for (int c = 0; c < 256; ++c) {
+		if (!m->starts[c]) continue;
+		m->starts_lo[c & 0x0f] |= 1 << ((c >> 4) & 7);
+		m->starts_hi[c >> 4] |= 1 << ((c >> 4) & 7);
+	}
+}
+
+static size_t hb_matcher_skip_scalar(const struct hb_matcher *m, const uint8_t *text,
+		size_t i, size_t len)
+{
+	while (i < len && !m->starts[text[i]]) ++i;
+	return i;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("ssse3")))
+static size_t hb_matcher_skip_ssse3(const struct hb_matcher *m, const uint8_t *text,
+		size_t i, size_t len)
+{
+	const __m128i lo = _mm_loadu_si128((const __m128i *) m->starts_lo);
+	const __m128i hi = _mm_loadu_si128((const __m128i *) m->starts_hi);
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) &text[i]);
+		__m128i l = _mm_shuffle_epi8(lo, _mm_and_si128(v, nibble));
+		__m128i h = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+		__m128i none = _mm_cmpeq_epi8(_mm_and_si128(l, h), _mm_setzero_si128());
+		unsigned bits = (unsigned) _mm_movemask_epi8(none) ^ 0xffff;
+
+		for (; bits; bits &= bits - 1) {
+			size_t j = i + (size_t) __builtin_ctz(bits);
+			if (m->starts[text[j]]) return j;
+		}
+	}
+
+	return hb_matcher_skip_scalar(m, text, i, len);
+}
+#endif
+
+struct hb_matcher *hb_matcher_from_file(const char *path)
+{
+	struct hb_matcher *m = calloc(1, sizeof(*m));
+	FILE *fp = fopen(path, "r");
+	char *line = NULL;
+	size_t line_cap = 0, patterns_cap = 0;
+	ssize_t len;
+
+	assert(m != NULL);
+	if (NULL == fp) {
+		free(m);
+		return NULL;
+	}
+
+	while ((len = getline(&line, &line_cap, fp)) != -1) {
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+			line[--len] = '\0';
+		if (len == 0) continue;
+		if (m->pattern_count == patterns_cap) {
+			patterns_cap = patterns_cap ? patterns_cap * 2 : 64;
+			m->patterns = realloc(m->patterns, patterns_cap * sizeof(*m->patterns));
+			assert(m->patterns != NULL);
+		}
+		m->patterns[m->pattern_count] = strdup(line);
+		assert(m->patterns[m->pattern_count] != NULL);
+		m->pattern_count += 1;
+	}
+
+	free(line);
+	fclose(fp);
+
+	// Class 0 is every byte no pattern uses.
+	m->class_count = 1;
+	for (size_t i = 0; i < m->pattern_count; ++i) {
+		for (const uint8_t *p = (const uint8_t *) m->patterns[i]; *p; ++p) {
+			uint8_t c = hb_match_fold(*p);
+			if (m->classes[c]) continue;
+			m->classes[c] = (uint8_t) m->class_count++;
+			if (c >= 'a' && c <= 'z') m->classes[c - ('a' - 'A')] = m->classes[c];
+		}
+	}
+
+	hb_matcher_new_state(m);
+	for (size_t i = 0; i < m->pattern_count; ++i)
+		hb_matcher_add(m, (uint32_t) i);
+	hb_matcher_link(m);
+	hb_matcher_set_starts(m);
+
+	m->skip = hb_matcher_skip_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+	if (__builtin_cpu_supports("ssse3")) m->skip = hb_matcher_skip_ssse3;
+#endif
+
+	return m;
+}
+
+void hb_matcher_scan(const struct hb_matcher *m, const char *text, size_t len,
+		hb_match_fn fn, void *data)
+{
+	const uint8_t *p = (const uint8_t *) text;
+	uint32_t state = 0;
+
+	for (size_t i = 0; i < len; ++i) {
+		// Nothing is in progress at the root, jump to the next byte that
+		// can start a pattern.
+		if (state == 0 && (i = m->skip(m, p, i, len)) == len) return;
+
+		state = m->next[state * m->class_count + m->classes[p[i]]];
+		for (uint32_t s = m->match[state] != HB_MATCH_NONE ? state : m->dict[state];
+				s != HB_MATCH_NONE; s = m->dict[s])
+			if (!fn(m, m->match[s], i + 1, data)) return;
+	}
+}
+
+void hb_matcher_free(struct hb_matcher *m)
+{
+	for (size_t i = 0; i < m->pattern_count; ++i)
+		free(m->patterns[i]);
+	free(m->patterns);
+	free(m->next);
+	free(m->match);
+	free(m->dict);
+	free(m);
+}
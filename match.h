@@ -0,0 +1,52 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Aho-Corasick automaton over a list of literal phrases, matched ignoring
+// ASCII case. Once built it is only read, one matcher can be shared by any
+// number of replays and threads.
+struct hb_matcher
+{
+	char **patterns;
+	size_t pattern_count;
+	// Bytes are mapped to classes first so the transition table only has a
+	// column per byte that appears in some pattern, plus one for the rest.
+	uint8_t classes[256];
+	uint32_t class_count;
+	uint32_t *next;
+	// Pattern ending at a state (or UINT32_MAX) and the nearest shorter
+	// state along the failure links that also ends one.
+	uint32_t *match, *dict;
+	size_t state_count, state_cap;
+	// Bytes that can start a pattern, in nibble tables for the SSSE3 scan.
+	bool starts[256];
+	uint8_t starts_lo[16], starts_hi[16];
+	size_t (*skip)(const struct hb_matcher *m, const uint8_t *text, size_t i, size_t len);
+};
+
+// Return false to stop the scan.
+typedef bool (*hb_match_fn)(const struct hb_matcher *m, uint32_t pattern,
+		size_t end, void *data);
+
+// One phrase per line, empty lines are ignored.
+struct hb_matcher *hb_matcher_from_file(const char *path);
+void hb_matcher_scan(const struct hb_matcher *m, const char *text, size_t len,
+		hb_match_fn fn, void *data);
+void hb_matcher_free(struct hb_matcher *m);
@@ -0,0 +1,335 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "arena.h"
+#include "buf.h"
+#include "events.h"
+#include "hbr.h"
+#include "inflate.h"
+#include "pack.h"
+#include "stream_reader.h"
+
+bool hbr_pack_probe(const uint8_t *data, size_t len)
+{
+	return len >= 4 && ((uint32_t) data[0] << 24 | (uint32_t) data[1] << 16 |
+			(uint32_t) data[2] << 8 | (uint32_t) data[3]) == HBR_PACK_MAGIC;
+}
+
+// Bounds are checked as the layout is walked, a truncated or foreign file
+// is turned down rather than read past its end.
+static bool hbr_pack_has(const struct hb_stream_reader *s, size_t len)
+{
+	return s->len - s->offset >= len;
+}
+
+static bool hbr_pack_view(struct hb_stream_reader *s, struct hb_stream_reader *view)
+{
+	if (!hbr_pack_has(s, 4)) return false;
+	uint32_t len = hb_stream_reader_uint32(s);
+	if (!hbr_pack_has(s, len)) return false;
+	*view = (struct hb_stream_reader) { .data = &s->data[s->offset], .len = len, .offset = 0 };
+	s->offset += len;
+	return true;
+}
+
+static void *hbr_pack_calloc(struct hb_arena *arena, size_t count, size_t size)
+{
+	return arena ? hb_arena_calloc(arena, count * size) : calloc(count, size);
+}
+
+static struct hbr_pack *hbr_pack_reject(struct hbr_pack *pack)
+{
+	if (pack->arena) return NULL;
+	free(pack->stadiums);
+	free(pack->blocks);
+	free(pack);
+	return NULL;
+}
+
+struct hbr_pack *hbr_pack_open(struct hb_stream_reader *file, struct hb_arena *arena)
+{
+	struct hbr_pack *pack = hbr_pack_calloc(arena, 1, sizeof(*pack));
+	uint32_t max_raw_size = 0;
+
+	assert(pack != NULL);
+	pack->arena = arena;
+
+	struct hb_stream_reader r = { .data = file->data, .len = file->len, .offset = 0 };
+
+	if (!hbr_pack_has(&r, 13) || hb_stream_reader_uint32(&r) != HBR_PACK_MAGIC)
+		return hbr_pack_reject(pack);
+	pack->version = hb_stream_reader_uint32(&r);
+	pack->total_frames = hb_stream_reader_uint32(&r);
+	pack->codec = hb_stream_reader_uint8(&r);
+	if (pack->codec != HBR_PACK_CODEC_NONE && pack->codec != HBR_PACK_CODEC_DEFLATE)
+		return hbr_pack_reject(pack);
+
+	if (!hbr_pack_view(&r, &pack->header) || !hbr_pack_has(&r, 4))
+		return hbr_pack_reject(pack);
+
+	pack->stadium_count = hb_stream_reader_uint32(&r);
+	if ((r.len - r.offset) / 4 < pack->stadium_count) return hbr_pack_reject(pack);
+	pack->stadiums = hbr_pack_calloc(arena, pack->stadium_count, sizeof(*pack->stadiums));
+	assert(pack->stadium_count == 0 || pack->stadiums != NULL);
+	for (uint32_t i = 0; i < pack->stadium_count; ++i)
+		if (!hbr_pack_view(&r, &pack->stadiums[i])) return hbr_pack_reject(pack);
+
+	if (!hbr_pack_has(&r, 4)) return hbr_pack_reject(pack);
+	pack->block_count = hb_stream_reader_uint32(&r);
+	if ((r.len - r.offset) / 12 < pack->block_count) return hbr_pack_reject(pack);
+	pack->blocks = hbr_pack_calloc(arena, pack->block_count, sizeof(*pack->blocks));
+	assert(pack->block_count == 0 || pack->blocks != NULL);
+	for (uint32_t i = 0; i < pack->block_count; ++i) {
+		pack->blocks[i].frame = hb_stream_reader_uint32(&r);
+		pack->blocks[i].raw_size = hb_stream_reader_uint32(&r);
+		pack->blocks[i].size = hb_stream_reader_uint32(&r);
+		if (pack->codec == HBR_PACK_CODEC_NONE && pack->blocks[i].raw_size != pack->blocks[i].size)
+			return hbr_pack_reject(pack);
+		if (pack->blocks[i].raw_size > max_raw_size)
+			max_raw_size = pack->blocks[i].raw_size;
+	}
+
+	for (uint32_t i = 0; i < pack->block_count; ++i) {
+		if (!hbr_pack_has(&r, pack->blocks[i].size)) return hbr_pack_reject(pack);
+		pack->blocks[i].offset = r.offset;
+		r.offset += pack->blocks[i].size;
+	}
+
+	if (pack->codec == HBR_PACK_CODEC_DEFLATE && max_raw_size > 0) {
+		pack->scratch = arena ? hb_arena_alloc(arena, max_raw_size) : malloc(max_raw_size);
+		assert(pack->scratch != NULL);
+	}
+
+	pack->file = file;
+	return pack;
+}
+
+static void hbr_pack_load_block(struct hbr_pack *pack, uint32_t index)
+{
+	struct hbr_pack_block *block = &pack->blocks[index];
+
+	pack->next_block = index + 1;
+	pack->block.offset = 0;
+	pack->block.len = block->raw_size;
+
+	if (pack->codec == HBR_PACK_CODEC_NONE) {
+		pack->block.data = &pack->file->data[block->offset];
+		return;
+	}
+
+	struct hb_inflate_buf out = {
+		.data = pack->scratch, .cap = block->raw_size, .max = block->raw_size
+	};
+
+	pack->block.data = pack->scratch;
+	if (hb_inflate(&pack->file->data[block->offset], block->size, true, &out) != HB_INFLATE_OK ||
+			out.len != block->raw_size)
+		hb_stream_reader_fail(&pack->block);
+}
+
+bool hbr_pack_next_block(struct hbr_pack *pack)
+{
+	if (pack->next_block >= pack->block_count) return false;
+	hbr_pack_load_block(pack, pack->next_block);
+	return true;
+}
+
+uint32_t hbr_pack_seek(struct hbr_pack *pack, uint32_t frame)
+{
+	uint32_t lo = 0, hi = pack->block_count;
+
+	if (pack->block_count == 0) return 0;
+
+	// Last block starting at or before `frame`.
+	while (hi - lo > 1) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (pack->blocks[mid].frame <= frame) lo = mid;
+		else hi = mid;
+	}
+
+	hbr_pack_load_block(pack, lo);
+	return pack->blocks[lo].frame;
+}
+
+struct hb_stream_reader *hbr_pack_stadium(struct hbr_pack *pack, uint32_t index)
+{
+	if (index >= pack->stadium_count) return NULL;
+	pack->stadiums[index].offset = 0;
+	pack->stadiums[index].failed = false;
+	return &pack->stadiums[index];
+}
+
+void hbr_pack_free(struct hbr_pack *pack)
+{
+	hb_stream_reader_free(pack->file);
+	if (pack->arena) return;
+	free(pack->stadiums);
+	free(pack->blocks);
+	free(pack->scratch);
+	free(pack);
+}
+
+struct hbr_pack_stadiums
+{
+	size_t count;
+	struct { const uint8_t *chunk; uint32_t chunk_len; struct hb_stream_reader *inflated; } *list;
+};
+
+static uint32_t hbr_pack_stadium_index(struct hbr_pack_stadiums *stadiums,
+		uint8_t *chunk, uint32_t chunk_len)
+{
+	for (size_t i = 0; i < stadiums->count; ++i)
+		if (stadiums->list[i].chunk_len == chunk_len &&
+				!memcmp(stadiums->list[i].chunk, chunk, chunk_len))
+			return (uint32_t) i;
+
+	struct hb_stream_reader view = { .data = chunk, .len = chunk_len, .offset = 0 };
+	struct hb_stream_reader *inflated = hb_stream_reader_slice(&view, chunk_len);
+	hb_stream_reader_inflate(inflated, true);
+
+	stadiums->list = realloc(stadiums->list, (stadiums->count + 1) * sizeof(*stadiums->list));
+	assert(stadiums->list != NULL);
+	stadiums->list[stadiums->count].chunk = chunk;
+	stadiums->list[stadiums->count].chunk_len = chunk_len;
+	stadiums->list[stadiums->count].inflated = inflated;
+	return (uint32_t) stadiums->count++;
+}
+
+static void hbr_pack_flush_block(struct hb_buf *index, struct hb_buf *payload,
+		enum hbr_pack_codec codec, uint32_t frame, const uint8_t *data, size_t len)
+{
+	size_t size = len;
+
+	if (codec == HBR_PACK_CODEC_DEFLATE) {
+		z_stream strm = { .zalloc = Z_NULL, .zfree = Z_NULL, .opaque = Z_NULL };
+		int ret = deflateInit2(&strm, 1, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+		assert(ret == Z_OK);
+		size_t bound = deflateBound(&strm, len);
+		hb_buf_reserve(payload, bound);
+		strm.next_in = (Bytef *) data;
+		strm.avail_in = len;
+		strm.next_out = &payload->data[payload->len];
+		strm.avail_out = bound;
+		ret = deflate(&strm, Z_FINISH);
+		assert(ret == Z_STREAM_END);
+		(void) ret;
+		size = bound - strm.avail_out;
+		payload->len += size;
+		deflateEnd(&strm);
+	} else {
+		hb_buf_put(payload, data, len);
+	}
+
+	hb_buf_put_uint32(index, frame);
+	hb_buf_put_uint32(index, (uint32_t) len);
+	hb_buf_put_uint32(index, (uint32_t) size);
+}
+
+bool hbr_pack_write(const char *in_path, const char *out_path,
+		enum hbr_pack_codec codec)
+{
+	struct hbr *hbr = hbr_parse(in_path);
+
+	if (NULL == hbr || hbr->pack) {
+		if (hbr) hbr_free(hbr);
+		return false;
+	}
+
+	struct hb_stream_reader *s = hbr->stream;
+	struct hb_buf events = {0}, index = {0}, payload = {0}, out = {0};
+	struct hbr_pack_stadiums stadiums = {0};
+	struct hb_event *ev = malloc(sizeof(*ev));
+	uint32_t block_count = 0, block_frame = 0;
+	size_t block_start = 0, header_len = s->offset;
+
+	assert(ev != NULL);
+
+	for (;;) {
+		size_t start = s->offset;
+		uint32_t frame = hbr->current_frame;
+
+		if (!hbr_next_event(hbr, ev)) break;
+
+		if (events.len - block_start >= HBR_PACK_BLOCK_SIZE) {
+			hbr_pack_flush_block(&index, &payload, codec, block_frame,
+					&events.data[block_start], events.len - block_start);
+			block_count += 1;
+			block_start = events.len;
+			block_frame = frame;
+		}
+
+		if (ev->type != HB_EVENT_SET_STADIUM) {
+			hb_buf_put(&events, &s->data[start], s->offset - start);
+			continue;
+		}
+
+		// frame flag [+ frame delta] + by_player + type, then the chunk.
+		size_t chunk_at = start + 1 + (s->data[start] ? 4 : 0) + 5;
+		struct hb_stream_reader chunk = { .data = s->data, .len = s->len, .offset = chunk_at };
+		uint32_t chunk_len = hb_stream_reader_uint32(&chunk);
+
+		hb_buf_put(&events, &s->data[start], chunk_at - start);
+		hb_buf_put_uint32(&events, hbr_pack_stadium_index(&stadiums,
+					&s->data[chunk.offset], chunk_len));
+	}
+
+	if (events.len > block_start) {
+		hbr_pack_flush_block(&index, &payload, codec, block_frame,
+				&events.data[block_start], events.len - block_start);
+		block_count += 1;
+	}
+
+	hb_buf_put_uint32(&out, HBR_PACK_MAGIC);
+	hb_buf_put_uint32(&out, hbr->version);
+	hb_buf_put_uint32(&out, hbr->total_frames);
+	hb_buf_put_uint8(&out, codec);
+	hb_buf_put_uint32(&out, (uint32_t) header_len);
+	hb_buf_put(&out, s->data, header_len);
+	hb_buf_put_uint32(&out, (uint32_t) stadiums.count);
+	for (size_t i = 0; i < stadiums.count; ++i) {
+		hb_buf_put_uint32(&out, (uint32_t) stadiums.list[i].inflated->len);
+		hb_buf_put(&out, stadiums.list[i].inflated->data, stadiums.list[i].inflated->len);
+		hb_stream_reader_free(stadiums.list[i].inflated);
+	}
+	hb_buf_put_uint32(&out, block_count);
+
+	// A truncated replay would make a pack that looks whole.
+	bool valid = !hbr_failed(hbr);
+
+	if (valid) {
+		FILE *fp = fopen(out_path, "w");
+		valid = fp != NULL && fwrite(out.data, 1, out.len, fp) == out.len &&
+			fwrite(index.data, 1, index.len, fp) == index.len &&
+			fwrite(payload.data, 1, payload.len, fp) == payload.len;
+		if (fp != NULL) valid = fclose(fp) == 0 && valid;
+		if (!valid) perror(out_path);
+	}
+
+	free(stadiums.list);
+	hb_buf_free(&events);
+	hb_buf_free(&index);
+	hb_buf_free(&payload);
+	hb_buf_free(&out);
+	free(ev);
+	hbr_free(hbr);
+	return valid;
+}
@@ -0,0 +1,81 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "arena.h"
+#include "stream_reader.h"
+
+// Packed replay layout, big endian like the replay itself:
+//
+//   u32 magic, u32 version, u32 total frames, u8 codec
+//   u32 header length, inflated header bytes
+//   u32 stadium count, { u32 length, inflated stadium bytes }
+//   u32 block count, { u32 first frame, u32 raw size, u32 size }
+//   block payloads
+//
+// Blocks hold whole events of the original stream, with the stadium chunk
+// of HB_EVENT_SET_STADIUM replaced by a u32 index into the stadium table.
+// The header is kept as bytes and decoded again on every read. The whole
+// pack is read into memory, raw blocks are decoded where they lie and
+// deflated ones through a reused scratch buffer.
+
+#define HBR_PACK_MAGIC (0x4842504B)
+#define HBR_PACK_BLOCK_SIZE (64*1024)
+
+enum hbr_pack_codec
+{
+	HBR_PACK_CODEC_NONE    = 0,
+	HBR_PACK_CODEC_DEFLATE = 1
+};
+
+struct hbr_pack_block
+{
+	uint32_t frame, raw_size, size;
+	size_t offset;
+};
+
+struct hbr_pack
+{
+	struct hb_stream_reader *file;
+	uint32_t version, total_frames;
+	uint8_t codec;
+	struct hb_stream_reader header;
+	uint32_t stadium_count;
+	struct hb_stream_reader *stadiums;
+	uint32_t block_count, next_block;
+	struct hbr_pack_block *blocks;
+	struct hb_stream_reader block;
+	uint8_t *scratch;
+	struct hb_arena *arena;
+};
+
+bool hbr_pack_probe(const uint8_t *data, size_t len);
+// Reads the pack out of `file`, the file contents, which it then owns. NULL
+// when the layout does not hold together, `file` is left to the caller.
+struct hbr_pack *hbr_pack_open(struct hb_stream_reader *file, struct hb_arena *arena);
+bool hbr_pack_next_block(struct hbr_pack *pack);
+uint32_t hbr_pack_seek(struct hbr_pack *pack, uint32_t frame);
+// NULL when there is no stadium `index`.
+struct hb_stream_reader *hbr_pack_stadium(struct hbr_pack *pack, uint32_t index);
+void hbr_pack_free(struct hbr_pack *pack);
+
+// Returns false when `in_path` is not a valid replay or is packed already,
+// or when `out_path` cannot be written, which is reported on stderr.
+bool hbr_pack_write(const char *in_path, const char *out_path,
+		enum hbr_pack_codec codec);
@@ -20,13 +20,13 @@
 #include "player.h"
 
 void hb_player_list_add(struct hb_player_list *list, uint32_t id,
-		char *name, bool is_admin, char *country)
+		uint32_t name, bool is_admin, uint32_t country)
 {
 	struct hb_player player = {0};
 	player.id = id;
-	strcpy(player.name, name);
+	player.name = name;
 	player.is_admin = is_admin;
-	strcpy(player.country, country);
+	player.country = country;
 	list->players[list->length++] = player;
 }
 
@@ -25,7 +25,8 @@
 struct hb_player
 {
 	uint32_t id, input, disc_id;
-	char name[128], country[10], avatar[10];
+	// Interned, see intern.h.
+	uint32_t name, country, avatar;
 	bool is_admin;
 	enum hb_team team;
 	uint8_t number, kicking, desynced;
@@ -39,7 +40,7 @@ struct hb_player_list
 };
 
 void hb_player_list_add(struct hb_player_list *list, uint32_t id,
-		char *name, bool is_admin, char *country);
+		uint32_t name, bool is_admin, uint32_t country);
 void hb_player_list_remove(struct hb_player_list *list, uint32_t id);
 int hb_player_list_index_of(struct hb_player_list *list, uint32_t id);
 bool hb_player_list_contains(struct hb_player_list *list, uint32_t id);
@@ -0,0 +1,94 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "buf.h"
+#include "proto.h"
+
+static bool hbr_proto_read_all(int fd, uint8_t *data, size_t len)
+{
+	while (len > 0) {
+		ssize_t n = read(fd, data, len);
+		if (n == -1 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		data += n;
+		len -= n;
+	}
+	return true;
+}
+
+static uint32_t hbr_proto_prefix(const uint8_t *prefix)
+{
+	return (uint32_t) prefix[0] << 24 | (uint32_t) prefix[1] << 16 |
+		(uint32_t) prefix[2] << 8 | (uint32_t) prefix[3];
+}
+
+// Leaves room for the length prefix, filled in by hbr_proto_send.
+void hbr_proto_begin(struct hb_buf *b)
+{
+	b->len = 0;
+	hb_buf_put_uint32(b, 0);
+}
+
+bool hbr_proto_send(int fd, struct hb_buf *b)
+{
+	uint32_t len = (uint32_t)(b->len - 4);
+	const uint8_t *data = b->data;
+	size_t left = b->len;
+
+	b->data[0] = len >> 24;
+	b->data[1] = len >> 16;
+	b->data[2] = len >> 8;
+	b->data[3] = len;
+
+	while (left > 0) {
+		ssize_t n = send(fd, data, left, MSG_NOSIGNAL);
+		if (n == -1 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		data += n;
+		left -= n;
+	}
+
+	return true;
+}
+
+// Reads one message, its body ends up at the start of the buffer.
+bool hbr_proto_recv(int fd, struct hb_buf *b)
+{
+	uint8_t prefix[4];
+
+	if (!hbr_proto_read_all(fd, &prefix[0], sizeof(prefix))) return false;
+
+	uint32_t len = hbr_proto_prefix(&prefix[0]);
+
+	if (len > HBR_PROTO_MAX_MESSAGE) return false;
+
+	b->len = 0;
+	hb_buf_reserve(b, len);
+	b->len = len;
+	return hbr_proto_read_all(fd, b->data, len);
+}
+
+int64_t hbr_proto_framed(const uint8_t *data, size_t len, uint32_t max)
+{
+	if (len < 4) return 0;
+	uint32_t body = hbr_proto_prefix(data);
+	if (body > max) return -1;
+	return len - 4 >= body ? (int64_t) body + 4 : 0;
+}
@@ -0,0 +1,56 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "buf.h"
+
+// Every message is a u32 length followed by that many bytes, big endian.
+//
+// request:  u8 op, u32 event type mask, absolute path
+// response: u8 status, then by op
+//   header:   u32 version, u32 total frames, str room, str stadium,
+//             u16 count, { u32 id, str name, str country, u8 team }
+//   events:   { u32 frame, u32 by player, u8 type, u32 length, payload }
+//             payload is the event as stored in the replay, except for
+//             HB_EVENT_SET_STADIUM which carries the stadium name (str)
+//   stadiums: { u32 length, .hbs contents }
+//   error:    message
+//
+// str is a u16 length followed by the bytes, without terminator.
+
+#define HBR_PROTO_MAX_MESSAGE (64*1024*1024)
+
+enum hbr_proto_op
+{
+	HBR_PROTO_HEADER   = 0,
+	HBR_PROTO_EVENTS   = 1,
+	HBR_PROTO_STADIUMS = 2
+};
+
+enum hbr_proto_status
+{
+	HBR_PROTO_OK    = 0,
+	HBR_PROTO_ERROR = 1
+};
+
+void hbr_proto_begin(struct hb_buf *b);
+bool hbr_proto_send(int fd, struct hb_buf *b);
+bool hbr_proto_recv(int fd, struct hb_buf *b);
+// Size of the message at the start of `data`, length prefix included, once
+// all of it is there: 0 until then, -1 when its body is over `max` bytes.
+int64_t hbr_proto_framed(const uint8_t *data, size_t len, uint32_t max);
@@ -0,0 +1,72 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+// Replay layout for every supported version, decoders for each version
+// are instantiated from these tables in hbr.c. A field is only present in
+// versions `since` to `until`; supporting a new version means adding it to
+// HBR_VERSIONS and adjusting the ranges below.
+
+// X(version, team table)
+#define HBR_VERSIONS(X) \
+	X( 7, HBR_TEAMS_V7) \
+	X( 8, HBR_TEAMS_V7) \
+	X( 9, HBR_TEAMS_V7) \
+	X(10, HBR_TEAMS_V7) \
+	X(11, HBR_TEAMS_V7) \
+	X(12, HBR_TEAMS_V7)
+
+// Team for each id byte, ids past the table are spectators.
+// FIXME: this is not ok, seems like team id is parsed in different ways
+// depending on the version, every version shares this table until the
+// real encodings are known.
+#define HBR_TEAMS_V7 { HB_TEAM_BLUE, HB_TEAM_RED }
+
+// X(field, kind, since, until)
+#define HBR_HEADER_SCHEMA(X) \
+	X(start_frame,       uint32,   7, 12) \
+	X(room_name,         interned, 7, 12) \
+	X(teams_lock,        boolean,  7, 12) \
+	X(score_limit,       uint8,    7, 12) \
+	X(time_limit,        uint8,    7, 12) \
+	X(rules_timer,       uint32,   7, 12) \
+	X(kick_off_taken,    uint8,    7, 12) \
+	X(kick_off_team,     uint8,    7, 12) \
+	X(ball_x,            double,   7, 12) \
+	X(ball_y,            double,   7, 12) \
+	X(score_red,         uint32,   7, 12) \
+	X(score_blue,        uint32,   7, 12) \
+	X(match_time,        double,   7, 12) \
+	X(pause_timer,       uint8,    7, 12) \
+	X(stadium,           stadium,  7, 12) \
+	X(in_game_disc_list, game,     7, 12) \
+	X(player_list,       players,  7, 12) \
+	X(red_shirt,         shirt,   12, 12) \
+	X(blue_shirt,        shirt,   12, 12)
+
+#define HBR_PLAYER_SCHEMA(X) \
+	X(id,                uint32,   7, 12) \
+	X(name,              interned, 7, 12) \
+	X(is_admin,          boolean,  7, 12) \
+	X(team,              team,     7, 12) \
+	X(number,            uint8,    7, 12) \
+	X(avatar,            interned, 7, 12) \
+	X(input,             uint32,   7, 12) \
+	X(kicking,           uint8,    7, 12) \
+	X(desynced,          uint8,    7, 12) \
+	X(country,           interned, 7, 12) \
+	X(handicap,          uint16,  11, 12) \
+	X(disc_id,           uint32,   7, 12)
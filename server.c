@@ -0,0 +1,364 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "arena.h"
+#include "buf.h"
+#include "events.h"
+#include "hbr.h"
+#include "intern.h"
+#include "proto.h"
+#include "server.h"
+#include "stream_reader.h"
+
+// Requests are at most an op, a mask and a path.
+#define HBR_SERVER_MAX_REQUEST (5 + PATH_MAX)
+
+struct hbr_server_conn
+{
+	int fd;
+	struct hb_buf request;
+	// Set by the poller when the client hung up or broke the framing.
+	bool broken;
+};
+
+struct hbr_server
+{
+	int epoll;
+	struct hbr_server_conn *queue[HBR_SERVER_QUEUE_SIZE];
+	size_t head, count;
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty, not_full;
+};
+
+struct hbr_server_worker
+{
+	struct hbr_server *server;
+	struct hb_buf response;
+	struct hb_event *ev;
+	struct hb_arena arena;
+};
+
+static void hbr_server_push(struct hbr_server *server, struct hbr_server_conn *conn)
+{
+	pthread_mutex_lock(&server->lock);
+	while (server->count == HBR_SERVER_QUEUE_SIZE)
+		pthread_cond_wait(&server->not_full, &server->lock);
+	server->queue[(server->head + server->count++) % HBR_SERVER_QUEUE_SIZE] = conn;
+	pthread_cond_signal(&server->not_empty);
+	pthread_mutex_unlock(&server->lock);
+}
+
+static struct hbr_server_conn *hbr_server_pop(struct hbr_server *server)
+{
+	pthread_mutex_lock(&server->lock);
+	while (server->count == 0)
+		pthread_cond_wait(&server->not_empty, &server->lock);
+	struct hbr_server_conn *conn = server->queue[server->head];
+	server->head = (server->head + 1) % HBR_SERVER_QUEUE_SIZE;
+	server->count -= 1;
+	pthread_cond_signal(&server->not_full);
+	pthread_mutex_unlock(&server->lock);
+	return conn;
+}
+
+static void hbr_server_error(struct hb_buf *res, const char *message)
+{
+	hbr_proto_begin(res);
+	hb_buf_put_uint8(res, HBR_PROTO_ERROR);
+	hb_buf_put(res, message, strlen(message));
+}
+
+static void hbr_server_header(struct hbr *hbr, struct hb_buf *res)
+{
+	hb_buf_put_uint32(res, hbr->version);
+	hb_buf_put_uint32(res, hbr->total_frames);
+	hb_buf_put_string(res, hb_intern_str(hbr->room_name));
+	hb_buf_put_string(res, hbr->default_stadium ? hbr->default_stadium : hbr->stadium.name);
+	hb_buf_put_uint16(res, (uint16_t) hbr->player_list.length);
+	for (size_t i = 0; i < hbr->player_list.length; ++i) {
+		struct hb_player *player = &hbr->player_list.players[i];
+		hb_buf_put_uint32(res, player->id);
+		hb_buf_put_string(res, hb_intern_str(player->name));
+		hb_buf_put_string(res, hb_intern_str(player->country));
+		hb_buf_put_uint8(res, (uint8_t) player->team);
+	}
+}
+
+static void hbr_server_events(struct hbr *hbr, uint32_t mask,
+		struct hb_event *ev, struct hb_buf *res)
+{
+	struct hb_stream_reader *s = hbr->stream;
+
+	while (res->len - 4 <= HBR_PROTO_MAX_MESSAGE && hbr_next_event(hbr, ev) > 0) {
+		if (!(mask & (1u << ev->type))) continue;
+
+		hb_buf_put_uint32(res, hbr->current_frame);
+		hb_buf_put_uint32(res, ev->by_player);
+		hb_buf_put_uint8(res, ev->type);
+
+		if (ev->type == HB_EVENT_SET_STADIUM) {
+			const char *name = ev->set_stadium.default_stadium ?
+				ev->set_stadium.default_stadium : ev->set_stadium.stadium.name;
+			hb_buf_put_uint32(res, (uint32_t) strnlen(name, UINT16_MAX) + 2);
+			hb_buf_put_string(res, name);
+			continue;
+		}
+
+		hb_buf_put_uint32(res, (uint32_t)(s->offset - hbr->event_offset));
+		hb_buf_put(res, &s->data[hbr->event_offset], s->offset - hbr->event_offset);
+	}
+}
+
+static void hbr_server_put_stadium(struct hb_stadium *stadium, struct hb_buf *res)
+{
+	stadium->can_be_stored = true;
+	char *hbs_data = hb_stadium_to_str(stadium);
+	size_t len = strlen(hbs_data);
+	hb_buf_put_uint32(res, (uint32_t) len);
+	hb_buf_put(res, hbs_data, len);
+	free(hbs_data);
+}
+
+static void hbr_server_stadiums(struct hbr *hbr, struct hb_event *ev,
+		struct hb_buf *res)
+{
+	if (NULL == hbr->default_stadium)
+		hbr_server_put_stadium(&hbr->stadium, res);
+
+	while (res->len - 4 <= HBR_PROTO_MAX_MESSAGE && hbr_next_event(hbr, ev) > 0)
+		if (ev->type == HB_EVENT_SET_STADIUM && NULL == ev->set_stadium.default_stadium)
+			hbr_server_put_stadium(&ev->set_stadium.stadium, res);
+}
+
+static void hbr_server_handle(struct hbr_server_worker *w, uint8_t *req, size_t len)
+{
+	struct hb_buf *res = &w->response;
+	char path[PATH_MAX];
+
+	if (len < 5 || len - 5 >= sizeof(path)) {
+		hbr_server_error(res, "malformed request");
+		return;
+	}
+
+	struct hb_stream_reader r = { .data = req, .len = len, .offset = 0 };
+	uint8_t op = hb_stream_reader_uint8(&r);
+	uint32_t mask = hb_stream_reader_uint32(&r);
+	hb_stream_reader_string_ascii(&r, len - r.offset, sizeof(path), path);
+
+	if (op > HBR_PROTO_STADIUMS) {
+		hbr_server_error(res, "unknown operation");
+		return;
+	}
+
+	if (path[0] != '/') {
+		hbr_server_error(res, "path is not absolute");
+		return;
+	}
+
+	if (access(path, R_OK) == -1) {
+		hbr_server_error(res, strerror(errno));
+		return;
+	}
+
+	struct hbr *hbr = hbr_parse_arena(path, &w->arena);
+
+	if (NULL == hbr) {
+		hbr_server_error(res, "invalid or unsupported replay");
+		hb_arena_reset(&w->arena);
+		return;
+	}
+
+	hbr_proto_begin(res);
+	hb_buf_put_uint8(res, HBR_PROTO_OK);
+
+	switch (op) {
+	case HBR_PROTO_HEADER: hbr_server_header(hbr, res); break;
+	case HBR_PROTO_EVENTS: hbr_server_events(hbr, mask, w->ev, res); break;
+	case HBR_PROTO_STADIUMS: hbr_server_stadiums(hbr, w->ev, res); break;
+	}
+
+	if (hbr_failed(hbr)) hbr_server_error(res, "truncated or malformed replay");
+	else if (res->len - 4 > HBR_PROTO_MAX_MESSAGE) hbr_server_error(res, "response too large, narrow the event mask");
+
+	hbr_free(hbr);
+	hb_arena_reset(&w->arena);
+	hb_intern_trim();
+}
+
+// Connections are only in the epoll set while nobody handles them: the
+// poller takes a readable one out, and it goes back in once the poller has
+// read what is there or its requests have been answered.
+static bool hbr_server_watch(struct hbr_server *server, struct hbr_server_conn *conn)
+{
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = conn };
+	return epoll_ctl(server->epoll, EPOLL_CTL_ADD, conn->fd, &ev) == 0;
+}
+
+static void hbr_server_close(struct hbr_server_conn *conn)
+{
+	close(conn->fd);
+	hb_buf_free(&conn->request);
+	free(conn);
+}
+
+// Takes what the client has sent so far without blocking, up to a whole
+// request. False once it hung up or sent something that is not one.
+static bool hbr_server_read(struct hbr_server_conn *conn)
+{
+	struct hb_buf *req = &conn->request;
+	int64_t size;
+
+	while ((size = hbr_proto_framed(req->data, req->len, HBR_SERVER_MAX_REQUEST)) == 0) {
+		hb_buf_reserve(req, 4096);
+		ssize_t n = recv(conn->fd, &req->data[req->len], req->cap - req->len, MSG_DONTWAIT);
+		if (n == -1 && errno == EINTR) continue;
+		if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+		if (n <= 0) return false;
+		req->len += (size_t) n;
+	}
+
+	return size > 0;
+}
+
+// Requests are read whole by the poller, so a slow client never holds on to
+// a worker, except to take its response for up to HBR_SERVER_SEND_TIMEOUT.
+// Connections are only ever closed here.
+static void *hbr_server_work(void *arg)
+{
+	struct hbr_server_worker *w = arg;
+
+	for (;;) {
+		struct hbr_server_conn *conn = hbr_server_pop(w->server);
+		struct hb_buf *req = &conn->request;
+		bool sent = !conn->broken;
+		int64_t size = 0;
+
+		// Requests sent ahead are buffered already and answered in turn.
+		while (sent && (size = hbr_proto_framed(req->data, req->len, HBR_SERVER_MAX_REQUEST)) > 0) {
+			hbr_server_handle(w, &req->data[4], (size_t) size - 4);
+			sent = hbr_proto_send(conn->fd, &w->response);
+			memmove(req->data, &req->data[size], req->len - (size_t) size);
+			req->len -= (size_t) size;
+		}
+
+		if (!sent || size < 0 || !hbr_server_watch(w->server, conn))
+			hbr_server_close(conn);
+	}
+
+	return NULL;
+}
+
+int hbr_serve(const char *socket_path, size_t workers)
+{
+	static struct hbr_server server = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.not_empty = PTHREAD_COND_INITIALIZER,
+		.not_full = PTHREAD_COND_INITIALIZER
+	};
+
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct epoll_event events[64];
+	int fd;
+
+	if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "socket path too long\n");
+		return 1;
+	}
+
+	strcpy(addr.sun_path, socket_path);
+	unlink(socket_path);
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1 ||
+			bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 ||
+			listen(fd, 128) == -1) {
+		perror("socket");
+		return 1;
+	}
+
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+	if ((server.epoll = epoll_create1(EPOLL_CLOEXEC)) == -1 ||
+			epoll_ctl(server.epoll, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		perror("epoll");
+		return 1;
+	}
+
+	for (size_t i = 0; i < workers; ++i) {
+		pthread_t thread;
+		struct hbr_server_worker *w = calloc(1, sizeof(*w));
+		if (NULL == w || NULL == (w->ev = malloc(sizeof(*w->ev)))) {
+			perror("malloc");
+			return 1;
+		}
+		w->server = &server;
+		if (pthread_create(&thread, NULL, hbr_server_work, w) != 0) {
+			perror("pthread_create");
+			return 1;
+		}
+		pthread_detach(thread);
+	}
+
+	for (;;) {
+		int count = epoll_wait(server.epoll, events, sizeof(events) / sizeof(events[0]), -1);
+		if (count == -1) {
+			if (errno == EINTR) continue;
+			perror("epoll_wait");
+			return 1;
+		}
+
+		for (int i = 0; i < count; ++i) {
+			struct hbr_server_conn *conn = events[i].data.ptr;
+
+			if (conn) {
+				epoll_ctl(server.epoll, EPOLL_CTL_DEL, conn->fd, NULL);
+				conn->broken = !hbr_server_read(conn);
+				if (!conn->broken && hbr_proto_framed(conn->request.data, conn->request.len,
+							HBR_SERVER_MAX_REQUEST) == 0) {
+					if (hbr_server_watch(&server, conn)) continue;
+					conn->broken = true;
+				}
+				hbr_server_push(&server, conn);
+				continue;
+			}
+
+			int client = accept(fd, NULL, NULL);
+			if (client == -1) {
+				if (errno == EINTR || errno == ECONNABORTED) continue;
+				perror("accept");
+				return 1;
+			}
+
+			struct timeval timeout = { .tv_sec = HBR_SERVER_SEND_TIMEOUT };
+			setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+			if (NULL == (conn = calloc(1, sizeof(*conn)))) {
+				perror("calloc");
+				return 1;
+			}
+			conn->fd = client;
+			if (!hbr_server_watch(&server, conn)) hbr_server_close(conn);
+		}
+	}
+}
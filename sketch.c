@@ -0,0 +1,174 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sketch.h"
+
+uint64_t hb_sketch_hash(const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	uint64_t h = 0xcbf29ce484222325;
+
+	// FNV-1a, then a splitmix64 finalizer so every bit depends on every
+	// byte, which HyperLogLog needs of the top bits.
+	for (size_t i = 0; i < len; ++i)
+		h = (h ^ p[i]) * 0x100000001b3;
+	h ^= h >> 30; h *= 0xbf58476d1ce4e5b9;
+	h ^= h >> 27; h *= 0x94d049bb133111eb;
+	h ^= h >> 31;
+	return h;
+}
+
+void hb_hll_add(struct hb_hll *hll, uint64_t hash)
+{
+	size_t index = hash >> (64 - HB_HLL_BITS);
+	// The guard bit caps the rank when every remaining bit is zero.
+	uint64_t rest = (hash << HB_HLL_BITS) | (1ull << (HB_HLL_BITS - 1));
+	uint8_t rank = (uint8_t) __builtin_clzll(rest) + 1;
+	if (rank > hll->registers[index]) hll->registers[index] = rank;
+}
+
+void hb_hll_merge(struct hb_hll *dst, const struct hb_hll *src)
+{
+	for (size_t i = 0; i < HB_HLL_REGISTERS; ++i)
+		if (src->registers[i] > dst->registers[i])
+			dst->registers[i] = src->registers[i];
+}
+
+double hb_hll_estimate(const struct hb_hll *hll)
+{
+	const double m = HB_HLL_REGISTERS;
+	double sum = 0.0;
+	size_t zeros = 0;
+
+	for (size_t i = 0; i < HB_HLL_REGISTERS; ++i) {
+		sum += ldexp(1.0, -hll->registers[i]);
+		zeros += hll->registers[i] == 0;
+	}
+
+	double estimate = (0.7213 / (1.0 + 1.079 / m)) * m * m / sum;
+	// Linear counting is more accurate while many registers are empty.
+	if (estimate <= 2.5 * m && zeros > 0)
+		estimate = m * log(m / (double) zeros);
+	return estimate;
+}
+
+static int hb_tdigest_compare(const void *a, const void *b)
+{
+	double x = ((const struct hb_tdigest_centroid *) a)->mean;
+	double y = ((const struct hb_tdigest_centroid *) b)->mean;
+	return (x > y) - (x < y);
+}
+
+// Quantile at which the k1 scale function is one unit past `q`, a centroid
+// may grow up to there.
+static double hb_tdigest_limit(double q)
+{
+	const double d = HB_TDIGEST_COMPRESSION;
+	double k = d / (2.0 * M_PI) * asin(2.0 * q - 1.0) + 1.0;
+	if (k >= d / 4.0) return 1.0;
+	return (sin(k * 2.0 * M_PI / d) + 1.0) / 2.0;
+}
+
+void hb_tdigest_compress(struct hb_tdigest *td)
+{
+	struct hb_tdigest_centroid *c = td->centroids;
+	size_t out = 0;
+	double before = 0.0, limit;
+
+	if (td->length < 2) return;
+	qsort(c, td->length, sizeof(*c), hb_tdigest_compare);
+
+	limit = hb_tdigest_limit(0.0);
+	for (size_t i = 1; i < td->length; ++i) {
+		double q = (before + c[out].weight + c[i].weight) / td->total;
+		if (q <= limit) {
+			c[out].mean += (c[i].mean - c[out].mean) * c[i].weight / (c[out].weight + c[i].weight);
+			c[out].weight += c[i].weight;
+			continue;
+		}
+		before += c[out].weight;
+		limit = hb_tdigest_limit(before / td->total);
+		c[++out] = c[i];
+	}
+
+	td->length = out + 1;
+}
+
+void hb_tdigest_add(struct hb_tdigest *td, double value, double weight)
+{
+	if (td->length == HB_TDIGEST_CAPACITY) hb_tdigest_compress(td);
+	td->centroids[td->length++] = (struct hb_tdigest_centroid) { value, weight };
+	td->total += weight;
+}
+
+void hb_tdigest_merge(struct hb_tdigest *dst, const struct hb_tdigest *src)
+{
+	for (size_t i = 0; i < src->length; ++i)
+		hb_tdigest_add(dst, src->centroids[i].mean, src->centroids[i].weight);
+}
+
+double hb_tdigest_quantile(struct hb_tdigest *td, double q)
+{
+	const struct hb_tdigest_centroid *c = td->centroids;
+	double target, before = 0.0;
+
+	hb_tdigest_compress(td);
+	if (td->length == 0) return NAN;
+
+	// Each centroid stands for its mean at the middle of its weight,
+	// interpolate between the two around the target.
+	target = q * td->total;
+	for (size_t i = 0; i < td->length; ++i) {
+		double mid = before + c[i].weight / 2.0;
+		if (target < mid) {
+			if (i == 0) return c[0].mean;
+			double prev = before - c[i - 1].weight / 2.0;
+			return c[i - 1].mean + (c[i].mean - c[i - 1].mean) * (target - prev) / (mid - prev);
+		}
+		before += c[i].weight;
+	}
+
+	return c[td->length - 1].mean;
+}
+
+void hb_cms_add(struct hb_cms *cms, uint64_t hash, uint64_t count)
+{
+	uint32_t h1 = (uint32_t) hash, h2 = (uint32_t) (hash >> 32);
+	for (uint32_t i = 0; i < HB_CMS_DEPTH; ++i)
+		cms->counts[i][(h1 + i * h2) % HB_CMS_WIDTH] += count;
+}
+
+void hb_cms_merge(struct hb_cms *dst, const struct hb_cms *src)
+{
+	for (size_t i = 0; i < HB_CMS_DEPTH; ++i)
+		for (size_t j = 0; j < HB_CMS_WIDTH; ++j)
+			dst->counts[i][j] += src->counts[i][j];
+}
+
+uint64_t hb_cms_estimate(const struct hb_cms *cms, uint64_t hash)
+{
+	uint32_t h1 = (uint32_t) hash, h2 = (uint32_t) (hash >> 32);
+	uint64_t estimate = UINT64_MAX;
+	for (uint32_t i = 0; i < HB_CMS_DEPTH; ++i) {
+		uint64_t count = cms->counts[i][(h1 + i * h2) % HB_CMS_WIDTH];
+		if (count < estimate) estimate = count;
+	}
+	return estimate;
+}
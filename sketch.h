@@ -0,0 +1,72 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Mergeable summaries: merging the sketches of two sets gives the sketch
+// of their union, so partial results can be combined in any order.
+
+uint64_t hb_sketch_hash(const void *data, size_t len);
+
+// HyperLogLog distinct counter, ~3% standard error.
+#define HB_HLL_BITS (10)
+#define HB_HLL_REGISTERS (1 << HB_HLL_BITS)
+
+struct hb_hll
+{
+	uint8_t registers[HB_HLL_REGISTERS];
+};
+
+void hb_hll_add(struct hb_hll *hll, uint64_t hash);
+void hb_hll_merge(struct hb_hll *dst, const struct hb_hll *src);
+double hb_hll_estimate(const struct hb_hll *hll);
+
+// Merging t-digest with the k1 scale function, quantiles are most precise
+// near the tails.
+#define HB_TDIGEST_COMPRESSION (100)
+#define HB_TDIGEST_CAPACITY (5 * HB_TDIGEST_COMPRESSION)
+
+struct hb_tdigest_centroid
+{
+	double mean, weight;
+};
+
+struct hb_tdigest
+{
+	struct hb_tdigest_centroid centroids[HB_TDIGEST_CAPACITY];
+	size_t length;
+	double total;
+};
+
+void hb_tdigest_add(struct hb_tdigest *td, double value, double weight);
+void hb_tdigest_merge(struct hb_tdigest *dst, const struct hb_tdigest *src);
+void hb_tdigest_compress(struct hb_tdigest *td);
+double hb_tdigest_quantile(struct hb_tdigest *td, double q);
+
+// Count-min sketch, never underestimates.
+#define HB_CMS_WIDTH (2048)
+#define HB_CMS_DEPTH (4)
+
+struct hb_cms
+{
+	uint64_t counts[HB_CMS_DEPTH][HB_CMS_WIDTH];
+};
+
+void hb_cms_add(struct hb_cms *cms, uint64_t hash, uint64_t count);
+void hb_cms_merge(struct hb_cms *dst, const struct hb_cms *src);
+uint64_t hb_cms_estimate(const struct hb_cms *cms, uint64_t hash);
@@ -20,13 +20,10 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdint.h>
-#include <zlib.h>
+#include "inflate.h"
 
 #define HB_STREAM_READER_MAX_INFLATED_SIZE (1024*1024*100)
 
-#define HB_STREAM_READER_VALID_READ_ASSERT(s, req) \
-	assert(s->len - s->offset >= (req))
-
 #define HB_STREAM_READER_XXX(s, type) do { \
 	uint8_t data[sizeof(type)]; \
 	hb_stream_reader_uint8_array_rev(s, sizeof(type), &data[0]); \
@@ -34,23 +31,44 @@
 	return ret; \
 } while (0)
 
-struct hb_stream_reader *hb_stream_reader_new(size_t len)
+static void *hb_stream_reader_alloc(struct hb_arena *arena, size_t len)
 {
-	struct hb_stream_reader *s = malloc(sizeof(struct hb_stream_reader));
-	assert(s != NULL);
+	void *p = arena ? hb_arena_alloc(arena, len) : malloc(len);
+	assert(p != NULL);
+	return p;
+}
+
+void hb_stream_reader_fail(struct hb_stream_reader *s)
+{
+	s->failed = true;
+	s->offset = s->len;
+}
+
+static bool hb_stream_reader_has(struct hb_stream_reader *s, size_t req)
+{
+	if (s->len - s->offset >= req) return true;
+	hb_stream_reader_fail(s);
+	return false;
+}
+
+struct hb_stream_reader *hb_stream_reader_new(struct hb_arena *arena, size_t len)
+{
+	struct hb_stream_reader *s = hb_stream_reader_alloc(arena, sizeof(struct hb_stream_reader));
 	s->offset = 0;
 	s->len = len;
-	s->data = malloc(s->len);
-	assert(s->data != NULL);
+	s->arena = arena;
+	s->failed = false;
+	s->data = hb_stream_reader_alloc(arena, s->len);
 	return s;
 }
 
-struct hb_stream_reader *hb_stream_reader_from_file(const char *path)
+struct hb_stream_reader *hb_stream_reader_from_file(struct hb_arena *arena,
+                                                    const char *path)
 {
 	FILE *fp = fopen(path, "r");
 	assert(fp != NULL);
 	fseek(fp, 0, SEEK_END);
-	struct hb_stream_reader *s = hb_stream_reader_new(ftell(fp));
+	struct hb_stream_reader *s = hb_stream_reader_new(arena, ftell(fp));
 	assert(s != NULL);
 	fseek(fp, 0, SEEK_SET);
 	fread(s->data, s->len, 1, fp);
@@ -58,12 +76,28 @@ struct hb_stream_reader *hb_stream_reader_from_file(const char *path)
 	return s;
 }
 
+struct hb_stream_reader *hb_stream_reader_from_buffer(struct hb_arena *arena,
+                                                      uint8_t *data, size_t len)
+{
+	assert(arena != NULL);
+	struct hb_stream_reader *s = hb_stream_reader_alloc(arena, sizeof(struct hb_stream_reader));
+	s->offset = 0;
+	s->len = len;
+	s->arena = arena;
+	s->failed = false;
+	s->data = data;
+	return s;
+}
+
 struct hb_stream_reader *hb_stream_reader_slice(struct hb_stream_reader *s,
                                                 size_t len)
 {
-	HB_STREAM_READER_VALID_READ_ASSERT(s, len);
-	struct hb_stream_reader *slice = hb_stream_reader_new(len);
-	if (!slice) return NULL;
+	if (!hb_stream_reader_has(s, len)) {
+		struct hb_stream_reader *slice = hb_stream_reader_new(s->arena, 0);
+		slice->failed = true;
+		return slice;
+	}
+	struct hb_stream_reader *slice = hb_stream_reader_new(s->arena, len);
 	memcpy(&slice->data[0], &s->data[s->offset], len);
 	s->offset += len;
 	return slice;
@@ -73,7 +107,10 @@ static void hb_stream_reader_uint8_array_rev(struct hb_stream_reader *s,
                                              size_t len,
                                              uint8_t *arr)
 {
-	HB_STREAM_READER_VALID_READ_ASSERT(s, len);
+	if (!hb_stream_reader_has(s, len)) {
+		memset(arr, 0, len);
+		return;
+	}
 
 	for (size_t i = 0; i < len; ++i)
 		arr[len - i - 1] = s->data[s->offset + i];
@@ -87,6 +124,7 @@ int16_t    hb_stream_reader_int16(struct hb_stream_reader *s) { HB_STREAM_READER
 uint16_t  hb_stream_reader_uint16(struct hb_stream_reader *s) { HB_STREAM_READER_XXX(s,  uint16_t); }
 int32_t    hb_stream_reader_int32(struct hb_stream_reader *s) { HB_STREAM_READER_XXX(s,   int32_t); }
 uint32_t  hb_stream_reader_uint32(struct hb_stream_reader *s) { HB_STREAM_READER_XXX(s,  uint32_t); }
+uint64_t  hb_stream_reader_uint64(struct hb_stream_reader *s) { HB_STREAM_READER_XXX(s,  uint64_t); }
 float      hb_stream_reader_float(struct hb_stream_reader *s) { HB_STREAM_READER_XXX(s,     float); }
 double    hb_stream_reader_double(struct hb_stream_reader *s) { HB_STREAM_READER_XXX(s,    double); }
 bool        hb_stream_reader_bool(struct hb_stream_reader *s) { return !!hb_stream_reader_uint8(s); }
@@ -97,39 +135,76 @@ void hb_stream_reader_string_ascii(struct hb_stream_reader *s,
                                    char *str)
 {
 	assert(cap != 0);
-	HB_STREAM_READER_VALID_READ_ASSERT(s, len);
-	if (len == 0) { str[0] = '\0'; return; }
+	if (!hb_stream_reader_has(s, len) || len == 0) { str[0] = '\0'; return; }
 	size_t read_count = len >= cap ? cap - 1 : len;
 	memcpy(str, &s->data[s->offset], read_count);
 	str[read_count] = '\0';
 	s->offset += len;
 }
 
+struct hb_str_view hb_stream_reader_string_view(struct hb_stream_reader *s)
+{
+	struct hb_str_view view;
+	view.len = hb_stream_reader_uint16(s);
+	if (!hb_stream_reader_has(s, view.len)) return (struct hb_str_view) { "", 0 };
+	view.data = (const char *) &s->data[s->offset];
+	s->offset += view.len;
+	return view;
+}
+
+void hb_stream_reader_skip(struct hb_stream_reader *s, size_t len)
+{
+	if (hb_stream_reader_has(s, len)) s->offset += len;
+}
+
+void hb_str_view_copy(struct hb_str_view view, size_t cap, char *str)
+{
+	assert(cap != 0);
+	size_t count = view.len >= cap ? cap - 1 : view.len;
+	memcpy(str, view.data, count);
+	str[count] = '\0';
+}
+
 void hb_stream_reader_inflate(struct hb_stream_reader *s, bool raw)
 {
-	uint8_t *inflated = malloc(HB_STREAM_READER_MAX_INFLATED_SIZE);
+	if (!hb_stream_reader_try_inflate(s, raw)) hb_stream_reader_fail(s);
+}
 
-	z_stream strm = { .zalloc = Z_NULL, .zfree = Z_NULL, .opaque = Z_NULL };
-	strm.avail_in = s->len - s->offset;
-	strm.next_in = &s->data[s->offset];
-	strm.avail_out = HB_STREAM_READER_MAX_INFLATED_SIZE;
-	strm.next_out = inflated;
+bool hb_stream_reader_try_inflate(struct hb_stream_reader *s, bool raw)
+{
+	struct hb_inflate_buf out = { .max = HB_STREAM_READER_MAX_INFLATED_SIZE, .arena = s->arena };
 
-	assert((raw ? inflateInit2(&strm, -15) : inflateInit(&strm)) == Z_OK);
-	assert((inflate(&strm, Z_FINISH)) == Z_STREAM_END);
+	if (hb_inflate(&s->data[s->offset], s->len - s->offset, raw, &out) != HB_INFLATE_OK) {
+		if (NULL == s->arena) free(out.data);
+		return false;
+	}
 
-	free(s->data);
+	if (NULL == s->arena) free(s->data);
 	s->offset = 0;
-	s->len = HB_STREAM_READER_MAX_INFLATED_SIZE - strm.avail_out;
-	s->data = malloc(s->len);
+	s->len = out.len;
+	s->data = out.data;
+	return true;
+}
 
-	memcpy(s->data, inflated, s->len);
-	inflateEnd(&strm);
-	free(inflated);
+void hb_stream_reader_inflate_sized(struct hb_stream_reader *s, bool raw,
+                                    size_t size)
+{
+	struct hb_inflate_buf out = { .cap = size, .max = size, .arena = s->arena };
+
+	out.data = hb_stream_reader_alloc(s->arena, size);
+	int status = hb_inflate(&s->data[s->offset], s->len - s->offset, raw, &out);
+	assert(status == HB_INFLATE_OK && out.len == size);
+	(void) status;
+
+	if (NULL == s->arena) free(s->data);
+	s->offset = 0;
+	s->len = out.len;
+	s->data = out.data;
 }
 
 void hb_stream_reader_free(struct hb_stream_reader *s)
 {
+	if (s->arena) return;
 	free(s->data);
 	free(s);
 }
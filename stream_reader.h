@@ -18,19 +18,40 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include "arena.h"
+
 #define hb_stream_reader_string_ascii_auto(stream, str) \
 	hb_stream_reader_string_ascii(stream, hb_stream_reader_uint16(stream), \
 			sizeof(str), &str[0])
 
+// Bytes of a string inside the reader's buffer, not NUL terminated and only
+// valid while the buffer is.
+struct hb_str_view {
+	const char *data;
+	uint16_t len;
+};
+
+// A read past the end fails the reader: it returns zeroes from then on and
+// stays at its end, the caller checks `failed` once it is done.
 struct hb_stream_reader {
 	uint8_t *data;
 	size_t len, offset;
+	struct hb_arena *arena;
+	bool failed;
 };
 
-struct hb_stream_reader *hb_stream_reader_new(size_t len);
-struct hb_stream_reader *hb_stream_reader_from_file(const char *path);
+struct hb_stream_reader *hb_stream_reader_new(struct hb_arena *arena, size_t len);
+struct hb_stream_reader *hb_stream_reader_from_file(struct hb_arena *arena,
+		const char *path);
+// Reads `data` in place, the reader never owns it so an arena is required
+// (the first inflate replaces it with arena memory).
+struct hb_stream_reader *hb_stream_reader_from_buffer(struct hb_arena *arena,
+		uint8_t *data, size_t len);
+// Fails both readers when `s` holds less than `len` bytes.
 struct hb_stream_reader *hb_stream_reader_slice(struct hb_stream_reader *s,
 		size_t len);
+// For data that reads fine but makes no sense, same as a read past the end.
+void hb_stream_reader_fail(struct hb_stream_reader *s);
 
 int8_t      hb_stream_reader_int8(struct hb_stream_reader *s);
 uint8_t    hb_stream_reader_uint8(struct hb_stream_reader *s);
@@ -38,6 +59,7 @@ int16_t    hb_stream_reader_int16(struct hb_stream_reader *s);
 uint16_t  hb_stream_reader_uint16(struct hb_stream_reader *s);
 int32_t    hb_stream_reader_int32(struct hb_stream_reader *s);
 uint32_t  hb_stream_reader_uint32(struct hb_stream_reader *s);
+uint64_t  hb_stream_reader_uint64(struct hb_stream_reader *s);
 float      hb_stream_reader_float(struct hb_stream_reader *s);
 double    hb_stream_reader_double(struct hb_stream_reader *s);
 bool        hb_stream_reader_bool(struct hb_stream_reader *s);
@@ -45,5 +67,15 @@ bool        hb_stream_reader_bool(struct hb_stream_reader *s);
 void hb_stream_reader_string_ascii(struct hb_stream_reader *s,
 		uint32_t len, size_t cap, char *str);
 
+struct hb_str_view hb_stream_reader_string_view(struct hb_stream_reader *s);
+void hb_stream_reader_skip(struct hb_stream_reader *s, size_t len);
+void hb_str_view_copy(struct hb_str_view view, size_t cap, char *str);
+
+// Fails the reader when the stream does not inflate.
 void hb_stream_reader_inflate(struct hb_stream_reader *s, bool raw);
+// Same, but a stream that does not inflate is left as it is and false
+// returned.
+bool hb_stream_reader_try_inflate(struct hb_stream_reader *s, bool raw);
+void hb_stream_reader_inflate_sized(struct hb_stream_reader *s, bool raw,
+		size_t size);
 void hb_stream_reader_free(struct hb_stream_reader *s);
@@ -0,0 +1,63 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "tar.h"
+
+#define HB_TAR_BLOCK (512)
+
+struct hb_tar_header
+{
+	char name[100], mode[8], uid[8], gid[8], size[12], mtime[12], checksum[8];
+	char type, link[100], magic[6], version[2], user[32], group[32];
+	char major[8], minor[8], prefix[155], pad[12];
+};
+
+void hb_tar_put(FILE *fp, const char *name, const void *data, size_t len)
+{
+	static const uint8_t zeros[HB_TAR_BLOCK];
+	struct hb_tar_header h;
+	unsigned sum = 0;
+
+	memset(&h, 0, sizeof(h));
+	snprintf(h.name, sizeof(h.name), "%s", name);
+	memcpy(h.mode, "0000644", 8);
+	memcpy(h.uid, "0000000", 8);
+	memcpy(h.gid, "0000000", 8);
+	snprintf(h.size, sizeof(h.size), "%011zo", len);
+	snprintf(h.mtime, sizeof(h.mtime), "%011llo", (unsigned long long) time(NULL));
+	h.type = '0';
+	memcpy(h.magic, "ustar", 6);
+	memcpy(h.version, "00", 2);
+
+	// Summed with the checksum field itself taken as spaces.
+	memset(h.checksum, ' ', sizeof(h.checksum));
+	for (size_t i = 0; i < sizeof(h); ++i) sum += ((const uint8_t *) &h)[i];
+	snprintf(h.checksum, sizeof(h.checksum), "%06o", sum);
+
+	fwrite(&h, 1, sizeof(h), fp);
+	fwrite(data, 1, len, fp);
+	fwrite(zeros, 1, (HB_TAR_BLOCK - len % HB_TAR_BLOCK) % HB_TAR_BLOCK, fp);
+}
+
+void hb_tar_end(FILE *fp)
+{
+	static const uint8_t zeros[2 * HB_TAR_BLOCK];
+	fwrite(zeros, 1, sizeof(zeros), fp);
+}
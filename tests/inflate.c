@@ -0,0 +1,128 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "../arena.h"
+#include "../inflate.h"
+
+// Version, magic and total frames come before the zlib body.
+#define SAMPLE_PREFIX (12)
+
+static uint8_t *read_file(const char *path, size_t *len)
+{
+	FILE *fp = fopen(path, "rb");
+	assert(fp != NULL);
+	fseek(fp, 0, SEEK_END);
+	*len = (size_t) ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	uint8_t *data = malloc(*len);
+	assert(data != NULL);
+	size_t read = fread(data, 1, *len, fp);
+	assert(read == *len);
+	(void) read;
+	fclose(fp);
+	return data;
+}
+
+// Reference output straight from zlib, outside of any backend.
+static uint8_t *zlib_uncompress(const uint8_t *in, size_t len, size_t *out_len)
+{
+	uLongf cap = len * 4, dest_len;
+	uint8_t *out = NULL;
+	int ret;
+
+	do {
+		cap *= 2;
+		out = realloc(out, cap);
+		assert(out != NULL);
+		dest_len = cap;
+		ret = uncompress(out, &dest_len, in, len);
+	} while (ret == Z_BUF_ERROR);
+
+	assert(ret == Z_OK);
+	*out_len = dest_len;
+	return out;
+}
+
+static void same_output(const uint8_t *in, size_t len, bool raw,
+		const uint8_t *expected, size_t expected_len)
+{
+	struct hb_arena arena = {0};
+	struct hb_inflate_buf grown = { .max = SIZE_MAX };
+	struct hb_inflate_buf sized = { .cap = expected_len, .max = expected_len };
+	struct hb_inflate_buf pooled = { .max = SIZE_MAX, .arena = &arena };
+	uint8_t *data;
+
+	assert(hb_inflate(in, len, raw, &grown) == HB_INFLATE_OK);
+	assert(grown.len == expected_len && !memcmp(grown.data, expected, expected_len));
+
+	// A buffer of the inflated size is filled in place.
+	sized.data = data = malloc(expected_len);
+	assert(hb_inflate(in, len, raw, &sized) == HB_INFLATE_OK);
+	assert(sized.data == data);
+	assert(sized.len == expected_len && !memcmp(sized.data, expected, expected_len));
+
+	assert(hb_inflate(in, len, raw, &pooled) == HB_INFLATE_OK);
+	assert(pooled.len == expected_len && !memcmp(pooled.data, expected, expected_len));
+
+	free(grown.data);
+	free(sized.data);
+	hb_arena_free(&arena);
+}
+
+static void rejected(const uint8_t *in, size_t len, size_t expected_len)
+{
+	struct hb_inflate_buf small = { .max = expected_len - 1 };
+	struct hb_inflate_buf cut = { .max = SIZE_MAX };
+
+	assert(hb_inflate(in, len, false, &small) == HB_INFLATE_OVERFLOW);
+	assert(hb_inflate(in, len / 2, false, &cut) == HB_INFLATE_ERROR);
+
+	free(small.data);
+	free(cut.data);
+}
+
+int
+main(void)
+{
+	static const struct hb_inflate_backend *backends[] = {
+		&hb_inflate_backend_zlib, &hb_inflate_backend_fast
+	};
+
+	size_t len, expected_len;
+	uint8_t *sample = read_file("sample.hbr", &len);
+	const uint8_t *body = &sample[SAMPLE_PREFIX];
+	size_t body_len = len - SAMPLE_PREFIX;
+	uint8_t *expected = zlib_uncompress(body, body_len, &expected_len);
+
+	for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); ++i) {
+		hb_inflate_backend_set(backends[i]);
+		same_output(body, body_len, false, expected, expected_len);
+		// Without the two byte zlib header, as stadium chunks are stored.
+		same_output(body + 2, body_len - 2, true, expected, expected_len);
+		rejected(body, body_len, expected_len);
+	}
+
+	free(expected);
+	free(sample);
+	printf("inflate: ok\n");
+	return 0;
+}
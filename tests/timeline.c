@@ -0,0 +1,174 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "../timeline.h"
+
+static void same_frame_back_to_previous(void)
+{
+	struct hb_input_timelines t = {0};
+	struct hb_input_timeline *tl = hb_input_timelines_get(&t, 0);
+	struct hb_input_stats stats;
+
+	hb_input_timeline_begin(tl, 0, 0, 0);
+	hb_input_timeline_record(tl, 10, HB_INPUT_KICK);
+	hb_input_timeline_record(tl, 20, HB_INPUT_UP);
+	hb_input_timeline_record(tl, 20, HB_INPUT_KICK);
+	hb_input_timeline_end(tl, 30);
+
+	assert(tl->length == 2);
+	assert(hb_input_timeline_at(tl, 25) == HB_INPUT_KICK);
+
+	hb_input_timeline_stats(tl, 1000, &stats);
+	assert(stats.actions == 1);
+	assert(stats.kicks == 1);
+
+	hb_input_timelines_free(&t);
+}
+
+static void same_frame_kick(void)
+{
+	struct hb_input_timelines t = {0};
+	struct hb_input_timeline *tl = hb_input_timelines_get(&t, 0);
+	struct hb_input_stats stats;
+
+	hb_input_timeline_begin(tl, 0, 0, HB_INPUT_UP);
+	hb_input_timeline_record(tl, 10, HB_INPUT_UP | HB_INPUT_KICK);
+	hb_input_timeline_record(tl, 10, HB_INPUT_UP);
+	hb_input_timeline_record(tl, 10, HB_INPUT_KICK);
+	hb_input_timeline_record(tl, 20, HB_INPUT_KICK);
+	hb_input_timeline_end(tl, 30);
+
+	assert(tl->length == 2);
+	assert(hb_input_timeline_at(tl, 5) == HB_INPUT_UP);
+	assert(hb_input_timeline_at(tl, 10) == HB_INPUT_KICK);
+
+	hb_input_timeline_stats(tl, 1000, &stats);
+	assert(stats.actions == 1);
+	assert(stats.kicks == 1);
+
+	hb_input_timelines_free(&t);
+}
+
+static void kicks_and_actions_per_minute(void)
+{
+	struct hb_input_timelines t = {0};
+	struct hb_input_timeline *tl = hb_input_timelines_get(&t, 0);
+	struct hb_input_stats stats;
+
+	// A tap every 10 s over 2 min, the kick held through a turn once.
+	hb_input_timeline_begin(tl, 0, 0, 0);
+	for (uint32_t frame = 600; frame < 7200; frame += 600) {
+		hb_input_timeline_record(tl, frame, HB_INPUT_KICK);
+		hb_input_timeline_record(tl, frame + 6, 0);
+	}
+	hb_input_timeline_record(tl, 7000, HB_INPUT_KICK);
+	hb_input_timeline_record(tl, 7003, HB_INPUT_KICK | HB_INPUT_UP);
+	hb_input_timeline_record(tl, 7006, 0);
+	hb_input_timeline_end(tl, 7200);
+
+	hb_input_timeline_stats(tl, 1000, &stats);
+	double minutes = stats.frames / (60.0 * HB_FRAMES_PER_SECOND);
+	assert(stats.frames == 7200);
+	assert(stats.kicks == 12);
+	assert(stats.actions == 25);
+	assert(stats.kicks / minutes == 6.0);
+	assert(stats.actions / minutes == 12.5);
+
+	hb_input_timelines_free(&t);
+}
+
+static void idle_without_input(void)
+{
+	struct hb_input_timelines t = {0};
+	struct hb_input_timeline *tl = hb_input_timelines_get(&t, 0);
+	struct hb_input_stats stats;
+
+	hb_input_timeline_begin(tl, 0, 0, 0);
+	hb_input_timeline_record(tl, 100, HB_INPUT_RIGHT);
+	hb_input_timeline_record(tl, 200, 0);
+	hb_input_timeline_record(tl, 1000, HB_INPUT_UP);
+	hb_input_timeline_record(tl, 1100, 0);
+	hb_input_timeline_end(tl, 1500);
+
+	// Only runs of at least the threshold count as idle.
+	hb_input_timeline_stats(tl, 300, &stats);
+	assert(stats.idle_frames == 800 + 400);
+	assert(stats.longest_idle == 800);
+
+	hb_input_timeline_stats(tl, 500, &stats);
+	assert(stats.idle_frames == 800);
+	assert(stats.longest_idle == 800);
+
+	hb_input_timelines_free(&t);
+}
+
+static void held_direction_is_not_idle(void)
+{
+	struct hb_input_timelines t = {0};
+	struct hb_input_timeline *tl = hb_input_timelines_get(&t, 0);
+	struct hb_input_stats stats;
+
+	hb_input_timeline_begin(tl, 0, 0, HB_INPUT_RIGHT);
+	hb_input_timeline_record(tl, 1000, 0);
+	hb_input_timeline_end(tl, 1100);
+
+	hb_input_timeline_stats(tl, 300, &stats);
+	assert(stats.idle_frames == 0);
+	assert(stats.longest_idle == 100);
+
+	hb_input_timelines_free(&t);
+}
+
+static void input_at_frame(void)
+{
+	struct hb_input_timelines t = {0};
+	struct hb_input_timeline *tl = hb_input_timelines_get(&t, 0);
+
+	assert(hb_input_timeline_at(tl, 0) == 0);
+
+	hb_input_timeline_begin(tl, 0, 10, HB_INPUT_LEFT);
+	hb_input_timeline_record(tl, 20, HB_INPUT_LEFT | HB_INPUT_KICK);
+	hb_input_timeline_record(tl, 30, 0);
+	hb_input_timeline_record(tl, 40, HB_INPUT_DOWN);
+	hb_input_timeline_end(tl, 50);
+
+	assert(hb_input_timeline_at(tl, 0) == 0);
+	assert(hb_input_timeline_at(tl, 9) == 0);
+	assert(hb_input_timeline_at(tl, 10) == HB_INPUT_LEFT);
+	assert(hb_input_timeline_at(tl, 19) == HB_INPUT_LEFT);
+	assert(hb_input_timeline_at(tl, 20) == (HB_INPUT_LEFT | HB_INPUT_KICK));
+	assert(hb_input_timeline_at(tl, 25) == (HB_INPUT_LEFT | HB_INPUT_KICK));
+	assert(hb_input_timeline_at(tl, 30) == 0);
+	assert(hb_input_timeline_at(tl, 39) == 0);
+	assert(hb_input_timeline_at(tl, 40) == HB_INPUT_DOWN);
+	assert(hb_input_timeline_at(tl, 60) == HB_INPUT_DOWN);
+
+	hb_input_timelines_free(&t);
+}
+
+int
+main(void)
+{
+	same_frame_back_to_previous();
+	same_frame_kick();
+	kicks_and_actions_per_minute();
+	idle_without_input();
+	held_direction_is_not_idle();
+	input_at_frame();
+	printf("timeline: ok\n");
+	return 0;
+}
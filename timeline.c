@@ -0,0 +1,145 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "timeline.h"
+
+struct hb_input_timeline *hb_input_timelines_get(struct hb_input_timelines *t, uint32_t id)
+{
+	if (id >= t->cap) {
+		size_t cap = t->cap ? t->cap : 64;
+		while (cap <= id) cap *= 2;
+		t->players = realloc(t->players, cap * sizeof(*t->players));
+		assert(t->players != NULL);
+		memset(&t->players[t->cap], 0, (cap - t->cap) * sizeof(*t->players));
+		t->cap = cap;
+	}
+
+	if (id >= t->length) t->length = id + 1;
+	return &t->players[id];
+}
+
+// Keeps the run arrays so the next replay does not allocate them again.
+void hb_input_timelines_reset(struct hb_input_timelines *t)
+{
+	for (size_t i = 0; i < t->length; ++i) {
+		struct hb_input_timeline *tl = &t->players[i];
+		tl->name = 0;
+		tl->present = false;
+		tl->first_frame = tl->last_frame = 0;
+		tl->length = 0;
+	}
+	t->length = 0;
+}
+
+void hb_input_timelines_free(struct hb_input_timelines *t)
+{
+	for (size_t i = 0; i < t->cap; ++i) {
+		free(t->players[i].frames);
+		free(t->players[i].inputs);
+	}
+	free(t->players);
+	memset(t, 0, sizeof(*t));
+}
+
+static void hb_input_timeline_push(struct hb_input_timeline *tl, uint32_t frame, uint8_t input)
+{
+	if (tl->length == tl->cap) {
+		tl->cap = tl->cap ? tl->cap * 2 : 256;
+		tl->frames = realloc(tl->frames, tl->cap * sizeof(*tl->frames));
+		tl->inputs = realloc(tl->inputs, tl->cap * sizeof(*tl->inputs));
+		assert(tl->frames != NULL && tl->inputs != NULL);
+	}
+
+	tl->frames[tl->length] = frame;
+	tl->inputs[tl->length] = input;
+	tl->length += 1;
+}
+
+void hb_input_timeline_begin(struct hb_input_timeline *tl, uint32_t name,
+		uint32_t frame, uint8_t input)
+{
+	tl->name = name;
+	tl->present = true;
+	tl->first_frame = tl->last_frame = frame;
+	tl->length = 0;
+	hb_input_timeline_push(tl, frame, input);
+}
+
+void hb_input_timeline_record(struct hb_input_timeline *tl, uint32_t frame, uint8_t input)
+{
+	if (!tl->present) return;
+	tl->last_frame = frame;
+	// Several changes within a frame, only the last one is ever seen. It may
+	// take the input back to that of the run before, which then goes on.
+	if (tl->frames[tl->length - 1] == frame) {
+		tl->inputs[tl->length - 1] = input;
+		if (tl->length > 1 && tl->inputs[tl->length - 2] == input) tl->length -= 1;
+		return;
+	}
+	if (tl->inputs[tl->length - 1] == input) return;
+	hb_input_timeline_push(tl, frame, input);
+}
+
+void hb_input_timeline_end(struct hb_input_timeline *tl, uint32_t frame)
+{
+	if (!tl->present) return;
+	tl->present = false;
+	tl->last_frame = frame;
+}
+
+uint8_t hb_input_timeline_at(const struct hb_input_timeline *tl, uint32_t frame)
+{
+	size_t lo = 0, hi = tl->length;
+
+	if (tl->length == 0 || frame < tl->frames[0]) return 0;
+
+	// Last run starting at or before `frame`.
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (tl->frames[mid] <= frame) lo = mid;
+		else hi = mid;
+	}
+
+	return tl->inputs[lo];
+}
+
+void hb_input_timeline_stats(const struct hb_input_timeline *tl,
+		uint32_t idle_threshold, struct hb_input_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	if (tl->length == 0) return;
+
+	stats->frames = tl->last_frame - tl->first_frame;
+	stats->actions = (uint32_t)(tl->length - 1);
+
+	for (size_t i = 0; i < tl->length; ++i) {
+		uint32_t end = i + 1 < tl->length ? tl->frames[i + 1] : tl->last_frame;
+		uint32_t held = end - tl->frames[i];
+
+		if (i > 0 && (tl->inputs[i] & HB_INPUT_KICK) && !(tl->inputs[i - 1] & HB_INPUT_KICK))
+			stats->kicks += 1;
+
+		// A held direction still moves the player, idle is no input at all.
+		if (tl->inputs[i] != 0) continue;
+		if (held >= idle_threshold) stats->idle_frames += held;
+		if (held > stats->longest_idle) stats->longest_idle = held;
+	}
+}
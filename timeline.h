@@ -0,0 +1,66 @@
+// ISC License (C) 2023 <alpheratz99@protonmail.com>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define HB_INPUT_UP    (1 << 0)
+#define HB_INPUT_DOWN  (1 << 1)
+#define HB_INPUT_LEFT  (1 << 2)
+#define HB_INPUT_RIGHT (1 << 3)
+#define HB_INPUT_KICK  (1 << 4)
+
+#define HB_FRAMES_PER_SECOND (60)
+
+// Input of a player as runs: inputs[i] is held from frames[i] until the
+// next run starts (or last_frame for the final one). Only changes are
+// stored, five bytes per change.
+struct hb_input_timeline
+{
+	uint32_t name;
+	bool present;
+	uint32_t first_frame, last_frame;
+	uint32_t *frames;
+	uint8_t *inputs;
+	size_t length, cap;
+};
+
+// Timelines indexed by player id, ids are handed out sequentially by the
+// room so the table stays dense.
+struct hb_input_timelines
+{
+	struct hb_input_timeline *players;
+	size_t length, cap;
+};
+
+struct hb_input_stats
+{
+	uint32_t frames, kicks, actions;
+	uint32_t idle_frames, longest_idle;
+};
+
+struct hb_input_timeline *hb_input_timelines_get(struct hb_input_timelines *t, uint32_t id);
+void hb_input_timelines_reset(struct hb_input_timelines *t);
+void hb_input_timelines_free(struct hb_input_timelines *t);
+
+void hb_input_timeline_begin(struct hb_input_timeline *tl, uint32_t name,
+		uint32_t frame, uint8_t input);
+void hb_input_timeline_record(struct hb_input_timeline *tl, uint32_t frame, uint8_t input);
+void hb_input_timeline_end(struct hb_input_timeline *tl, uint32_t frame);
+uint8_t hb_input_timeline_at(const struct hb_input_timeline *tl, uint32_t frame);
+void hb_input_timeline_stats(const struct hb_input_timeline *tl,
+		uint32_t idle_threshold, struct hb_input_stats *stats);